@@ -6,6 +6,23 @@ QT       += core network
 SOURCES += \
     $$PWD/qttelegrambot.cpp \
     $$PWD/networking.cpp \
+    $$PWD/requestbuilder.cpp \
+    $$PWD/updatestreamparser.cpp \
+    $$PWD/router.cpp \
+    $$PWD/sessionstore.cpp \
+    $$PWD/conversation.cpp \
+    $$PWD/broadcast.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/tracer.cpp \
+    $$PWD/ioworker.cpp \
+    $$PWD/bufferedreply.cpp \
+    $$PWD/chatdirectory.cpp \
+    $$PWD/callbackdata.cpp \
+    $$PWD/inlinequerycache.cpp \
+    $$PWD/interner.cpp \
+    $$PWD/mimedetector.cpp \
+    $$PWD/localtransport.cpp \
+    $$PWD/mappedfile.cpp \
     $$PWD/types/message.cpp \
     $$PWD/types/update.cpp \
     $$PWD/types/chat.cpp \
@@ -17,11 +34,33 @@ SOURCES += \
     $$PWD/types/video.cpp \
     $$PWD/types/voice.cpp \
     $$PWD/types/contact.cpp \
-    $$PWD/types/location.cpp
+    $$PWD/types/location.cpp \
+    $$PWD/types/callbackquery.cpp \
+    $$PWD/types/inlinequery.cpp
 
 HEADERS += \
     $$PWD/qttelegrambot.h \
     $$PWD/networking.h \
+    $$PWD/apimethods.h \
+    $$PWD/requestbuilder.h \
+    $$PWD/updatestreamparser.h \
+    $$PWD/router.h \
+    $$PWD/sessionstore.h \
+    $$PWD/conversation.h \
+    $$PWD/broadcast.h \
+    $$PWD/metrics.h \
+    $$PWD/tracer.h \
+    $$PWD/mpscqueue.h \
+    $$PWD/ioworker.h \
+    $$PWD/bufferedreply.h \
+    $$PWD/awaitable.h \
+    $$PWD/chatdirectory.h \
+    $$PWD/callbackdata.h \
+    $$PWD/inlinequerycache.h \
+    $$PWD/interner.h \
+    $$PWD/mimedetector.h \
+    $$PWD/localtransport.h \
+    $$PWD/mappedfile.h \
     $$PWD/types/message.h \
     $$PWD/types/update.h \
     $$PWD/types/chat.h \
@@ -35,10 +74,14 @@ HEADERS += \
     $$PWD/types/voice.h \
     $$PWD/types/contact.h \
     $$PWD/types/location.h \
+    $$PWD/types/callbackquery.h \
+    $$PWD/types/inlinequery.h \
     $$PWD/types/reply/genericreply.h \
     $$PWD/types/reply/replykeyboardmarkup.h \
     $$PWD/types/reply/replykeyboardhide.h \
-    $$PWD/types/reply/forcereply.h
+    $$PWD/types/reply/forcereply.h \
+    $$PWD/types/reply/encodedreply.h \
+    $$PWD/types/reply/inlinekeyboardmarkup.h
 
 OTHER_FILES += \
     $$PWD/README.md
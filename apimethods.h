@@ -0,0 +1,225 @@
+#ifndef APIMETHODS_H
+#define APIMETHODS_H
+
+#include <QString>
+
+#include "networking.h"
+#include "requestbuilder.h"
+#include "types/chat.h"
+#include "types/reply/genericreply.h"
+
+namespace Telegram {
+
+/**
+ * Typed descriptors of api methods, pass them to Bot::call.
+ *
+ *     Api::SendMessage request(chatId, "hello");
+ *     request.disableWebPagePreview = true;
+ *     bot->call(request, [](QNetworkReply *reply) { ... });
+ *
+ * A descriptor names its endpoint and HTTP method and hands its fields to an encoder in fields().
+ * encode() is instantiated per descriptor, so building the parameters compiles down to the
+ * RequestBuilder appends of exactly the fields that are set, without any lookup by name.
+ * Optional fields are left out while they have their default: empty strings, false, negative
+ * numbers and null markup.
+ */
+namespace Api {
+
+/**
+ * Adds the fields of a descriptor to a RequestBuilder.
+ */
+class FieldEncoder
+{
+public:
+    explicit FieldEncoder(RequestBuilder &params) : m_params(params) {}
+
+    template <typename T>
+    void operator()(const char *key, const T &value) { m_params.add(key, value); }
+
+    void optional(const char *key, const QString &value) { if (!value.isEmpty()) m_params.add(key, value); }
+    void optional(const char *key, const char *value) { if (value && *value) m_params.add(key, value); }
+    void optional(const char *key, bool value) { if (value) m_params.add(key, true); }
+    void optional(const char *key, qint32 value) { if (value >= 0) m_params.add(key, value); }
+    void optional(const char *key, const GenericReply *value) { if (value && value->isValid()) m_params.add(key, *value); }
+
+private:
+    RequestBuilder &m_params;
+};
+
+template <typename Method>
+RequestBuilder encode(const Method &request)
+{
+    RequestBuilder params;
+    FieldEncoder encoder(params);
+    request.fields(encoder);
+    return params;
+}
+
+struct GetMe
+{
+    static const char *endpoint() { return ENDPOINT_GET_ME; }
+    static const Networking::Method method = Networking::GET;
+
+    template <typename Encoder>
+    void fields(Encoder &) const {}
+};
+
+struct GetChat
+{
+    static const char *endpoint() { return ENDPOINT_GET_CHAT; }
+    static const Networking::Method method = Networking::GET;
+
+    explicit GetChat(const ChatId &chatId) : chatId(chatId) {}
+
+    ChatId chatId;
+
+    template <typename Encoder>
+    void fields(Encoder &e) const { e("chat_id", chatId); }
+};
+
+struct GetFile
+{
+    static const char *endpoint() { return ENDPOINT_GET_FILE; }
+    static const Networking::Method method = Networking::GET;
+
+    explicit GetFile(const QString &fileId) : fileId(fileId) {}
+
+    QString fileId;
+
+    template <typename Encoder>
+    void fields(Encoder &e) const { e("file_id", fileId); }
+};
+
+struct SendMessage
+{
+    static const char *endpoint() { return ENDPOINT_SEND_MESSAGE; }
+    static const Networking::Method method = Networking::POST;
+
+    SendMessage(const ChatId &chatId, const QString &text) :
+        chatId(chatId), text(text), parseMode(0), disableWebPagePreview(false), replyToMessageId(-1), replyMarkup(0) {}
+
+    ChatId chatId;
+    QString text;
+    const char *parseMode; // "Markdown" or 0
+    bool disableWebPagePreview;
+    qint32 replyToMessageId;
+    const GenericReply *replyMarkup; // has to live until the descriptor is passed to call
+
+    template <typename Encoder>
+    void fields(Encoder &e) const {
+        e("chat_id", chatId);
+        e("text", text);
+        e.optional("parse_mode", parseMode);
+        e.optional("disable_web_page_preview", disableWebPagePreview);
+        e.optional("reply_to_message_id", replyToMessageId);
+        e.optional("reply_markup", replyMarkup);
+    }
+};
+
+struct ForwardMessage
+{
+    static const char *endpoint() { return ENDPOINT_FORWARD_MESSAGE; }
+    static const Networking::Method method = Networking::POST;
+
+    ForwardMessage(const ChatId &chatId, const ChatId &fromChatId, qint32 messageId) :
+        chatId(chatId), fromChatId(fromChatId), messageId(messageId) {}
+
+    ChatId chatId;
+    ChatId fromChatId;
+    qint32 messageId;
+
+    template <typename Encoder>
+    void fields(Encoder &e) const {
+        e("chat_id", chatId);
+        e("from_chat_id", fromChatId);
+        e("message_id", messageId);
+    }
+};
+
+struct SendLocation
+{
+    static const char *endpoint() { return ENDPOINT_SEND_LOCATION; }
+    static const Networking::Method method = Networking::POST;
+
+    SendLocation(const ChatId &chatId, double latitude, double longitude) :
+        chatId(chatId), latitude(latitude), longitude(longitude), replyToMessageId(-1), replyMarkup(0) {}
+
+    ChatId chatId;
+    double latitude;
+    double longitude;
+    qint32 replyToMessageId;
+    const GenericReply *replyMarkup;
+
+    template <typename Encoder>
+    void fields(Encoder &e) const {
+        e("chat_id", chatId);
+        e("latitude", latitude);
+        e("longitude", longitude);
+        e.optional("reply_to_message_id", replyToMessageId);
+        e.optional("reply_markup", replyMarkup);
+    }
+};
+
+struct SendChatAction
+{
+    static const char *endpoint() { return ENDPOINT_SEND_CHAT_ACTION; }
+    static const Networking::Method method = Networking::POST;
+
+    SendChatAction(const ChatId &chatId, const char *action) : chatId(chatId), action(action) {}
+
+    ChatId chatId;
+    const char *action; // "typing", "upload_photo", ...
+
+    template <typename Encoder>
+    void fields(Encoder &e) const {
+        e("chat_id", chatId);
+        e("action", action);
+    }
+};
+
+struct SetChatTitle
+{
+    static const char *endpoint() { return ENDPOINT_SET_CHAT_TITLE; }
+    static const Networking::Method method = Networking::POST;
+
+    SetChatTitle(const ChatId &chatId, const QString &title) : chatId(chatId), title(title) {}
+
+    ChatId chatId;
+    QString title;
+
+    template <typename Encoder>
+    void fields(Encoder &e) const {
+        e("chat_id", chatId);
+        e("title", title);
+    }
+};
+
+struct AnswerCallbackQuery
+{
+    static const char *endpoint() { return ENDPOINT_ANSWER_CALLBACK_QUERY; }
+    static const Networking::Method method = Networking::POST;
+
+    explicit AnswerCallbackQuery(const QString &callbackQueryId) :
+        callbackQueryId(callbackQueryId), showAlert(false), cacheTime(-1) {}
+
+    QString callbackQueryId;
+    QString text;
+    bool showAlert;
+    QString url;
+    qint32 cacheTime;
+
+    template <typename Encoder>
+    void fields(Encoder &e) const {
+        e("callback_query_id", callbackQueryId);
+        e.optional("text", text);
+        e.optional("show_alert", showAlert);
+        e.optional("url", url);
+        e.optional("cache_time", cacheTime);
+    }
+};
+
+}
+
+}
+
+#endif // APIMETHODS_H
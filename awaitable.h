@@ -0,0 +1,229 @@
+#ifndef AWAITABLE_H
+#define AWAITABLE_H
+
+/**
+ * co_await support for Bot requests. Needs C++20 coroutines in the including translation unit,
+ * the library itself is still built as C++11. Without coroutine support this header is empty.
+ *
+ *     Telegram::Task onPhoto(Telegram::Bot *bot, Telegram::Message message)
+ *     {
+ *         auto file = co_await Telegram::getFile(bot, message.photo.last().fileId);
+ *         if (!file.ok)
+ *             co_return;
+ *         co_await Telegram::sendMessage(bot, message.chat.id, file.value.filePath);
+ *     }
+ *
+ * Awaiting resumes the coroutine from the request callback on the thread of the bot, there is
+ * no extra event loop round trip. The awaiter lives in the coroutine frame and the callback only
+ * captures a pointer to it, so a request costs no allocation beyond what the bot needs anyway.
+ */
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define QTTELEGRAMBOT_COROUTINES 1
+#endif
+#endif
+
+#ifdef QTTELEGRAMBOT_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "qttelegrambot.h"
+
+namespace Telegram {
+
+/**
+ * Fire and forget coroutine, starts immediately and frees itself when done.
+ */
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() noexcept { return Task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+/**
+ * Cancels the request a coroutine is currently waiting for.
+ * The awaiting coroutine resumes with an unsuccessful result.
+ */
+class CancelToken
+{
+public:
+    CancelToken() : m_bot(nullptr), m_id(0) {}
+
+    void cancel() {
+        if (m_bot && m_id)
+            m_bot->cancel(m_id);
+    }
+
+    // used by CallAwaiter
+    void attach(Bot *bot, quint64 id) { m_bot = bot; m_id = id; }
+    void detach() { m_bot = nullptr; m_id = 0; }
+
+private:
+    Bot *m_bot;
+    quint64 m_id;
+};
+
+/**
+ * Outcome of an api call. result holds the "result" member of the response.
+ */
+struct CallResult
+{
+    CallResult() : ok(false), errorCode(0), networkError(QNetworkReply::NoError) {}
+
+    bool ok;
+    int errorCode; // error_code of the api or HTTP status
+    QString description;
+    QJsonValue result;
+    QNetworkReply::NetworkError networkError;
+    bool dropped() const { return !ok && !errorCode && networkError == QNetworkReply::NoError; }
+};
+
+class CallAwaiter
+{
+public:
+    CallAwaiter(Bot *bot, const QString &endpoint, const RequestBuilder &params, Networking::Method method,
+                Networking::Priority priority, CancelToken *token) :
+        m_bot(bot), m_endpoint(endpoint), m_params(params), m_method(method), m_priority(priority), m_token(token) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        m_handle = handle;
+        CallAwaiter *self = this;
+        quint64 id = m_bot->call(m_endpoint, m_params, m_method, [self](QNetworkReply *reply) {
+            self->finish(reply);
+        }, m_priority);
+        if (m_token)
+            m_token->attach(m_bot, id);
+    }
+
+    CallResult await_resume() { return m_result; }
+
+private:
+    void finish(QNetworkReply *reply) {
+        if (m_token)
+            m_token->detach();
+        if (reply) {
+            m_result.networkError = reply->error();
+            const QJsonObject obj = QJsonDocument::fromJson(reply->readAll()).object();
+            m_result.ok = obj.value("ok").toBool();
+            m_result.result = obj.value("result");
+            m_result.description = obj.value("description").toString(reply->errorString());
+            m_result.errorCode = obj.value("error_code").toInt(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+        }
+        m_handle.resume();
+    }
+
+    Bot *m_bot;
+    QString m_endpoint;
+    RequestBuilder m_params;
+    Networking::Method m_method;
+    Networking::Priority m_priority;
+    CancelToken *m_token;
+    std::coroutine_handle<> m_handle;
+    CallResult m_result;
+};
+
+/**
+ * Result of a typed call, value is only meaningful if ok.
+ */
+template <typename T>
+struct Result
+{
+    bool ok;
+    T value;
+    CallResult call;
+};
+
+/**
+ * Awaits a CallResult and converts its result member to T.
+ */
+template <typename T>
+class TypedAwaiter
+{
+public:
+    typedef T (*Convert)(const QJsonValue &result);
+
+    TypedAwaiter(const CallAwaiter &call, Convert convert) : m_call(call), m_convert(convert) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { m_call.await_suspend(handle); }
+    Result<T> await_resume() {
+        CallResult call = m_call.await_resume();
+        return Result<T>{ call.ok, m_convert(call.result), call };
+    }
+
+private:
+    CallAwaiter m_call;
+    Convert m_convert;
+};
+
+/**
+ * Calls any endpoint.
+ * @param token - optional, cancels the request
+ */
+inline CallAwaiter call(Bot *bot, const QString &endpoint, const RequestBuilder &params = RequestBuilder(),
+                        Networking::Method method = Networking::POST, CancelToken *token = nullptr,
+                        Networking::Priority priority = Networking::Normal)
+{
+    return CallAwaiter(bot, endpoint, params, method, priority, token);
+}
+
+inline TypedAwaiter<User> getMe(Bot *bot, CancelToken *token = nullptr)
+{
+    return TypedAwaiter<User>(call(bot, ENDPOINT_GET_ME, RequestBuilder(), Networking::GET, token),
+                              [](const QJsonValue &v) { return User(v.toObject()); });
+}
+
+inline TypedAwaiter<Chat> getChat(Bot *bot, const ChatId &chatId, CancelToken *token = nullptr)
+{
+    RequestBuilder params;
+    params.add("chat_id", chatId);
+    return TypedAwaiter<Chat>(call(bot, ENDPOINT_GET_CHAT, params, Networking::GET, token),
+                              [](const QJsonValue &v) { return Chat(v.toObject()); });
+}
+
+inline TypedAwaiter<File> getFile(Bot *bot, const QString &fileId, CancelToken *token = nullptr)
+{
+    RequestBuilder params;
+    params.add("file_id", fileId);
+    return TypedAwaiter<File>(call(bot, ENDPOINT_GET_FILE, params, Networking::GET, token),
+                              [](const QJsonValue &v) {
+        const QJsonObject o = v.toObject();
+        return File(o.value("file_id").toString(), qint64(o.value("file_size").toDouble(-1)), o.value("file_path").toString());
+    });
+}
+
+inline TypedAwaiter<Message> sendMessage(Bot *bot, const ChatId &chatId, const QString &text, const RequestBuilder &extra = RequestBuilder(),
+                                         CancelToken *token = nullptr, Networking::Priority priority = Networking::Interactive)
+{
+    RequestBuilder params(extra);
+    params.add("chat_id", chatId);
+    params.add("text", text);
+    return TypedAwaiter<Message>(call(bot, ENDPOINT_SEND_MESSAGE, params, Networking::POST, token, priority),
+                                 [](const QJsonValue &v) { return Message(v.toObject()); });
+}
+
+inline CallAwaiter sendChatAction(Bot *bot, const ChatId &chatId, const char *action, CancelToken *token = nullptr)
+{
+    RequestBuilder params;
+    params.add("chat_id", chatId);
+    params.add("action", action);
+    return call(bot, ENDPOINT_SEND_CHAT_ACTION, params, Networking::POST, token, Networking::Interactive);
+}
+
+}
+
+#endif // QTTELEGRAMBOT_COROUTINES
+
+#endif // AWAITABLE_H
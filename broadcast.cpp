@@ -0,0 +1,190 @@
+#include <QPointer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "broadcast.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+Broadcast::Broadcast(Bot *bot, const QString &endpoint, const RequestBuilder &payload, const QVector<ChatId> &chatIds, QObject *parent) :
+    QObject(parent),
+    m_bot(bot),
+    m_endpoint(endpoint),
+    m_chatIds(chatIds),
+    m_rate(25),
+    m_batchSize(5),
+    m_maxInFlight(20),
+    m_inFlight(0),
+    m_position(0),
+    m_sent(0),
+    m_running(false)
+{
+    // encode everything but the chat_id once
+    QByteArray encoded = payload.encoded();
+    if (!encoded.isEmpty())
+        m_sharedBody = "&" + encoded;
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &Broadcast::sendBatch);
+}
+
+Broadcast::~Broadcast()
+{
+    m_timer.stop();
+    if (m_inFlight)
+        qCDebug(CTelBot) << __PRETTY_FUNCTION__ << "requests still pending" << m_inFlight;
+}
+
+void Broadcast::setRate(quint32 messagesPerSecond)
+{
+    m_rate = messagesPerSecond ? messagesPerSecond : 1;
+}
+
+void Broadcast::setBatchSize(quint32 batchSize)
+{
+    m_batchSize = batchSize ? batchSize : 1;
+}
+
+void Broadcast::setMaxInFlight(quint32 maxInFlight)
+{
+    m_maxInFlight = maxInFlight ? maxInFlight : 1;
+}
+
+void Broadcast::setPosition(int position)
+{
+    if (m_running) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "can't change position of a running broadcast";
+        return;
+    }
+    m_position = qBound(0, position, m_chatIds.size());
+}
+
+int Broadcast::position() const
+{
+    int position = m_position;
+    foreach (int index, m_unconfirmed)
+        position = qMin(position, index);
+    return position;
+}
+
+bool Broadcast::isFinished() const
+{
+    return m_position >= m_chatIds.size() && m_retries.isEmpty() && !m_inFlight;
+}
+
+void Broadcast::start()
+{
+    if (m_running) return;
+    m_running = true;
+    sendBatch();
+}
+
+void Broadcast::pause()
+{
+    m_running = false;
+    m_timer.stop();
+}
+
+void Broadcast::sendBatch()
+{
+    if (!m_running) return;
+
+    for (quint32 i = 0; i < m_batchSize && m_inFlight < m_maxInFlight; ++i) {
+        if (!m_retries.isEmpty()) {
+            sendTo(m_retries.takeFirst());
+        } else if (m_position < m_chatIds.size()) {
+            sendTo(m_position++);
+        } else
+            break;
+    }
+
+    if (m_position < m_chatIds.size() || !m_retries.isEmpty()) {
+        if (!m_timer.isActive())
+            m_timer.start((1000 * m_batchSize) / m_rate);
+    } else
+        checkFinished();
+}
+
+void Broadcast::sendTo(int index)
+{
+    const ChatId &chatId = m_chatIds.at(index);
+
+    QByteArray body;
+    body.reserve(8 + 20 + m_sharedBody.size());
+    body.append("chat_id=");
+    char decimal[ChatId::DecimalSize];
+    if (chatId.isNumeric())
+        body.append(decimal, chatId.decimal(decimal));
+    else
+        body.append(RequestBuilder::percentEncode(chatId.toString().toUtf8()));
+    body.append(m_sharedBody);
+
+    QPointer<Broadcast> self(this);
+    bool queued = m_bot->_asyncRequest(m_endpoint, body, Networking::POST,
+                                       [self, index](QNetworkReply *reply) {
+        if (self)
+            self->handleReply(index, reply);
+    }, Networking::Bulk);
+    if (queued) {
+        ++m_inFlight;
+        m_unconfirmed.insert(index);
+    } else {
+        m_unconfirmed.remove(index);
+        m_failed.append(m_chatIds.at(index));
+        emit recipientFailed(m_chatIds.at(index), 0, "request failed");
+    }
+}
+
+void Broadcast::handleReply(int index, QNetworkReply *reply)
+{
+    --m_inFlight;
+
+    if (!reply) {
+        // dropped by the scheduler at its deadline
+        m_unconfirmed.remove(index);
+        m_failed.append(m_chatIds.at(index));
+        emit recipientFailed(m_chatIds.at(index), 0, "request dropped");
+        emit progress(m_sent, m_failed.size(), m_chatIds.size());
+        checkFinished();
+        return;
+    }
+
+    // Telegram sends a json description for api errors as well, so parse the body first
+    QJsonObject obj = QJsonDocument::fromJson(reply->readAll()).object();
+    if (obj.value("ok").toBool()) {
+        m_unconfirmed.remove(index);
+        ++m_sent;
+    } else {
+        int errorCode = obj.value("error_code").toInt();
+        if (!errorCode)
+            errorCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (errorCode == 429) {
+            // flood control: retry this recipient once the server allows it again
+            int retryAfter = obj.value("parameters").toObject().value("retry_after").toInt(1);
+            m_retries.append(index);
+            m_bot->metrics()->recordRetry(m_endpoint);
+            if (m_running) {
+                m_timer.stop();
+                m_timer.start(1000 * retryAfter);
+            }
+            return;
+        }
+        m_unconfirmed.remove(index);
+        QString description = obj.value("description").toString();
+        if (description.isEmpty())
+            description = reply->errorString();
+        m_failed.append(m_chatIds.at(index));
+        emit recipientFailed(m_chatIds.at(index), errorCode, description);
+    }
+
+    emit progress(m_sent, m_failed.size(), m_chatIds.size());
+    checkFinished();
+}
+
+void Broadcast::checkFinished()
+{
+    if (m_running && isFinished()) {
+        m_running = false;
+        emit finished(m_sent, m_failed.size());
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <QObject>
+#include <QVector>
+#include <QSet>
+#include <QTimer>
+#include <QByteArray>
+
+#include "networking.h"
+#include "types/chat.h"
+
+namespace Telegram {
+
+class Bot;
+
+/**
+ * Sends one payload to many chats.
+ * The shared part of the request body is encoded once, only chat_id is substituted per recipient.
+ * Requests are sent in rate limited batches. Recipients that get a 429 (too many requests) are
+ * retried after the retry_after period reported by the server.
+ * A broadcast can be paused and resumed, also across restarts using position()/setPosition().
+ * Resuming from a stored position may send again to recipients after it that were already
+ * confirmed, never skips one.
+ */
+class Broadcast : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * Broadcast constructor. Use Bot::broadcast to create one.
+     * @param bot - bot used to send the requests
+     * @param endpoint - API endpoint, e.g. ENDPOINT_SEND_MESSAGE
+     * @param payload - parameters shared by all recipients (without chat_id)
+     * @param chatIds - recipients
+     * @param parent
+     */
+    Broadcast(Bot *bot, const QString &endpoint, const RequestBuilder &payload, const QVector<ChatId> &chatIds, QObject *parent = 0);
+    ~Broadcast();
+
+    /**
+     * Limits the sending rate. Telegram allows about 30 messages per second to different chats.
+     * @param messagesPerSecond - defaults to 25
+     */
+    void setRate(quint32 messagesPerSecond);
+
+    /**
+     * @param batchSize - number of requests sent per timer tick. Defaults to 5
+     */
+    void setBatchSize(quint32 batchSize);
+
+    /**
+     * @param maxInFlight - maximum number of unanswered requests. Defaults to 20
+     */
+    void setMaxInFlight(quint32 maxInFlight);
+
+    /**
+     * Index of the first recipient whose request is not confirmed yet: still unsent, in flight or
+     * waiting for a retry. Store it to resume an interrupted broadcast.
+     */
+    int position() const;
+
+    /**
+     * Continue with recipient index position. Call before start().
+     */
+    void setPosition(int position);
+
+    int total() const { return m_chatIds.size(); }
+    int sent() const { return m_sent; }
+    int failed() const { return m_failed.size(); }
+    const QVector<ChatId> &failedRecipients() const { return m_failed; }
+
+    bool isRunning() const { return m_running; }
+    bool isFinished() const;
+
+public slots:
+    void start();
+    void pause();
+
+signals:
+    void progress(int sent, int failed, int total);
+    void recipientFailed(const ChatId &chatId, int errorCode, const QString &description);
+    void finished(int sent, int failed);
+
+private slots:
+    void sendBatch();
+
+private:
+    void sendTo(int index);
+    void handleReply(int index, QNetworkReply *reply);
+    void checkFinished();
+
+    Bot *m_bot;
+    QString m_endpoint;
+    QByteArray m_sharedBody;
+    QVector<ChatId> m_chatIds;
+    QVector<ChatId> m_failed;
+    QVector<int> m_retries;
+    QSet<int> m_unconfirmed; // in flight or waiting for a retry
+    QTimer m_timer;
+    quint32 m_rate;
+    quint32 m_batchSize;
+    quint32 m_maxInFlight;
+    quint32 m_inFlight;
+    int m_position; // next recipient not sent to yet
+    int m_sent;
+    bool m_running;
+};
+
+}
+
+#endif // BROADCAST_H
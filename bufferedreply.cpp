@@ -0,0 +1,32 @@
+#include <cstring>
+#include "bufferedreply.h"
+
+using namespace Telegram;
+
+BufferedReply::BufferedReply(const QByteArray &data, QNetworkReply::NetworkError error, const QString &errorString, int httpStatus, QObject *parent) :
+    QNetworkReply(parent),
+    m_data(data),
+    m_pos(0)
+{
+    setOpenMode(QIODevice::ReadOnly);
+    setError(error, errorString);
+    if (httpStatus > 0)
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, httpStatus);
+    setHeader(QNetworkRequest::ContentLengthHeader, m_data.size());
+    setFinished(true);
+}
+
+qint64 BufferedReply::bytesAvailable() const
+{
+    return m_data.size() - m_pos + QNetworkReply::bytesAvailable();
+}
+
+qint64 BufferedReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 n = qMin(maxSize, qint64(m_data.size()) - m_pos);
+    if (n <= 0)
+        return m_pos >= m_data.size() ? -1 : 0;
+    memcpy(data, m_data.constData() + m_pos, size_t(n));
+    m_pos += n;
+    return n;
+}
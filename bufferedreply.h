@@ -0,0 +1,36 @@
+#ifndef BUFFEREDREPLY_H
+#define BUFFEREDREPLY_H
+
+#include <QNetworkReply>
+#include <QByteArray>
+
+namespace Telegram {
+
+/**
+ * Finished reply whose body is already in memory.
+ * Used to hand replies received on another thread to the callbacks of the bot.
+ */
+class BufferedReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    /**
+     * @param httpStatus - 0 if there was no HTTP response
+     */
+    BufferedReply(const QByteArray &data, QNetworkReply::NetworkError error, const QString &errorString, int httpStatus, QObject *parent = 0);
+
+    void abort() {}
+    bool isSequential() const { return true; }
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+private:
+    QByteArray m_data;
+    qint64 m_pos;
+};
+
+}
+
+#endif // BUFFEREDREPLY_H
@@ -0,0 +1,89 @@
+#include <QDebug>
+#include "callbackdata.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+CallbackDataWriter &CallbackDataWriter::addUInt(quint64 value)
+{
+    while (value >= 0x80) {
+        m_data += char(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    m_data += char(value);
+    return *this;
+}
+
+CallbackDataWriter &CallbackDataWriter::addInt(qint64 value)
+{
+    // zigzag, small negative numbers stay short
+    return addUInt((quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+CallbackDataWriter &CallbackDataWriter::addString(const QString &value)
+{
+    return addBytes(value.toUtf8());
+}
+
+CallbackDataWriter &CallbackDataWriter::addBytes(const QByteArray &value)
+{
+    addUInt(value.size());
+    m_data += value;
+    return *this;
+}
+
+QString CallbackDataWriter::encoded() const
+{
+    if (!fits()) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "callback data too large:" << m_data.size() << "bytes, at most" << int(MaxPackedSize);
+        return QString();
+    }
+    return QString::fromLatin1(m_data.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+CallbackDataReader::CallbackDataReader(const QString &data) :
+    m_pos(0),
+    m_valid(!data.isEmpty() && data.size() <= CallbackDataWriter::MaxEncodedSize)
+{
+    // fromBase64 skips characters outside the alphabet, forged data must not decode to something
+    for (int i = 0; i < data.size() && m_valid; ++i) {
+        const ushort c = data.at(i).unicode();
+        m_valid = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+    }
+    if (m_valid)
+        m_data = QByteArray::fromBase64(data.toLatin1(), QByteArray::Base64UrlEncoding);
+}
+
+quint64 CallbackDataReader::readUInt()
+{
+    quint64 value = 0;
+    for (int shift = 0; m_valid; shift += 7) {
+        if (m_pos >= m_data.size() || shift > 63) {
+            m_valid = false;
+            break;
+        }
+        const uchar c = m_data.at(m_pos++);
+        value |= quint64(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return value;
+    }
+    return 0;
+}
+
+qint64 CallbackDataReader::readInt()
+{
+    const quint64 v = readUInt();
+    return qint64(v >> 1) ^ -qint64(v & 1);
+}
+
+QByteArray CallbackDataReader::readBytes()
+{
+    const quint64 size = readUInt();
+    if (!m_valid || size > quint64(m_data.size() - m_pos)) {
+        m_valid = false;
+        return QByteArray();
+    }
+    QByteArray bytes = m_data.mid(m_pos, int(size));
+    m_pos += int(size);
+    return bytes;
+}
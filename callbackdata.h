@@ -0,0 +1,80 @@
+#ifndef CALLBACKDATA_H
+#define CALLBACKDATA_H
+
+#include <QByteArray>
+#include <QString>
+
+namespace Telegram {
+
+/**
+ * Packs structured state into the callback_data of an inline keyboard button, so a button press
+ * carries everything needed to handle it and no session lookup is needed.
+ * Fields are written back to back without names: integers as LEB128 varints (signed ones zigzag
+ * encoded), strings as varint length plus utf8. The result is base64url without padding, which
+ * leaves 48 bytes of packed fields within the 64 byte limit of callback_data.
+ *
+ *     CallbackDataWriter w;
+ *     w.addUInt(ActionVote).addUInt(pollId).addInt(delta);
+ *     InlineKeyboardButton::callback("+1", w.encoded());
+ *
+ *     CallbackDataReader r(query.data);
+ *     quint64 action = r.readUInt(), pollId = r.readUInt();
+ *     qint64 delta = r.readInt();
+ *     if (!r.isValid()) ...
+ */
+class CallbackDataWriter
+{
+public:
+    enum { MaxEncodedSize = 64, MaxPackedSize = MaxEncodedSize / 4 * 3 };
+
+    CallbackDataWriter() {}
+
+    CallbackDataWriter &addUInt(quint64 value);
+    CallbackDataWriter &addInt(qint64 value);
+    CallbackDataWriter &addBool(bool value) { return addUInt(value ? 1 : 0); }
+    CallbackDataWriter &addString(const QString &value);
+    CallbackDataWriter &addBytes(const QByteArray &value);
+
+    /**
+     * @return whether the fields written so far fit into callback_data
+     */
+    bool fits() const { return m_data.size() <= MaxPackedSize; }
+    int packedSize() const { return m_data.size(); }
+
+    /**
+     * @return base64url text for InlineKeyboardButton::callback, empty if it doesn't fit
+     */
+    QString encoded() const;
+
+private:
+    QByteArray m_data;
+};
+
+/**
+ * Reads fields in the order they were written by CallbackDataWriter. Reading past the end or
+ * malformed data (e.g. a forged button, characters outside base64url or more than 64 of them)
+ * makes the reader invalid, reads then return 0 or empty.
+ */
+class CallbackDataReader
+{
+public:
+    explicit CallbackDataReader(const QString &data);
+
+    quint64 readUInt();
+    qint64 readInt();
+    bool readBool() { return readUInt() != 0; }
+    QString readString() { return QString::fromUtf8(readBytes()); }
+    QByteArray readBytes();
+
+    bool isValid() const { return m_valid; }
+    bool atEnd() const { return m_pos >= m_data.size(); }
+
+private:
+    QByteArray m_data;
+    int m_pos;
+    bool m_valid;
+};
+
+}
+
+#endif // CALLBACKDATA_H
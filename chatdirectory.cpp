@@ -0,0 +1,156 @@
+#include <QPointer>
+#include "chatdirectory.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+ChatDirectory::ChatDirectory(Bot *bot, int capacity, quint32 ttl, QObject *parent) :
+    QObject(parent),
+    m_bot(bot),
+    m_ttl(qint64(ttl) * 1000),
+    m_chats(capacity),
+    m_users(capacity),
+    m_meFetched(-1)
+{
+    m_clock.start();
+    connect(m_bot, &Bot::message, this, &ChatDirectory::observe);
+}
+
+bool ChatDirectory::isFresh(qint64 fetched) const
+{
+    return fetched >= 0 && m_clock.elapsed() - fetched < m_ttl;
+}
+
+bool ChatDirectory::cachedChat(const ChatId &chatId, Chat &chat)
+{
+    Cached<Chat> *c = m_chats.object(chatId);
+    if (!c || !isFresh(c->fetched))
+        return false;
+    chat = c->value;
+    return true;
+}
+
+bool ChatDirectory::cachedUser(qint32 userId, User &user)
+{
+    Cached<User> *c = m_users.object(userId);
+    if (!c || !isFresh(c->fetched))
+        return false;
+    user = c->value;
+    return true;
+}
+
+void ChatDirectory::insert(const Chat &chat)
+{
+    if (!chat.id)
+        return;
+    const qint64 now = m_clock.elapsed();
+    Cached<Chat> *c = m_chats.object(ChatId(chat.id));
+    if (c) {
+        c->value = chat;
+        c->fetched = now;
+    } else {
+        m_chats.insert(ChatId(chat.id), new Cached<Chat>(chat, now));
+    }
+    if (!chat.username.isEmpty())
+        m_chats.insert(ChatId("@" + chat.username), new Cached<Chat>(chat, now));
+}
+
+void ChatDirectory::insert(const User &user)
+{
+    if (!user.id)
+        return;
+    const qint64 now = m_clock.elapsed();
+    Cached<User> *c = m_users.object(user.id);
+    if (c) {
+        c->value = user;
+        c->fetched = now;
+    } else {
+        m_users.insert(user.id, new Cached<User>(user, now));
+    }
+}
+
+void ChatDirectory::invalidate(const ChatId &chatId)
+{
+    m_chats.remove(chatId);
+}
+
+void ChatDirectory::observe(uint64_t updateId, Message message)
+{
+    Q_UNUSED(updateId);
+    insert(message.chat);
+    if (message.from.id)
+        insert(message.from);
+    if (message.forwardFrom.id)
+        insert(message.forwardFrom);
+    if (message.user.id)
+        insert(message.user);
+}
+
+void ChatDirectory::chat(const ChatId &chatId, ChatCallback fn)
+{
+    Chat c;
+    if (cachedChat(chatId, c)) {
+        fn(true, c);
+        return;
+    }
+
+    // coalesce concurrent lookups of the same chat into one request
+    auto it = m_pendingChats.find(chatId);
+    if (it != m_pendingChats.end()) {
+        it.value().append(fn);
+        return;
+    }
+    m_pendingChats[chatId].append(fn);
+
+    QPointer<ChatDirectory> self(this);
+    const ChatId key(chatId);
+    bool sent = m_bot->asyncGetChat(chatId, [self, key](bool ok, const Chat &chat) {
+        if (!self)
+            return;
+        if (ok) {
+            self->insert(chat);
+            emit self->chatAvailable(chat);
+        }
+        QVector<ChatCallback> waiting = self->m_pendingChats.take(key);
+        for (int i = 0; i < waiting.size(); ++i)
+            waiting[i](ok, chat);
+    });
+    if (!sent) {
+        QVector<ChatCallback> waiting = m_pendingChats.take(chatId);
+        for (int i = 0; i < waiting.size(); ++i)
+            waiting[i](false, Chat());
+    }
+}
+
+void ChatDirectory::me(UserCallback fn)
+{
+    if (isFresh(m_meFetched)) {
+        fn(true, m_me);
+        return;
+    }
+
+    m_pendingMe.append(fn);
+    if (m_pendingMe.size() > 1)
+        return; // request already running
+
+    QPointer<ChatDirectory> self(this);
+    bool sent = m_bot->asyncGetMe([self](bool ok, const User &user) {
+        if (!self)
+            return;
+        if (ok) {
+            self->m_me = user;
+            self->m_meFetched = self->m_clock.elapsed();
+            self->insert(user);
+        }
+        QVector<UserCallback> waiting;
+        waiting.swap(self->m_pendingMe);
+        for (int i = 0; i < waiting.size(); ++i)
+            waiting[i](ok, user);
+    });
+    if (!sent) {
+        QVector<UserCallback> waiting;
+        waiting.swap(m_pendingMe);
+        for (int i = 0; i < waiting.size(); ++i)
+            waiting[i](false, User());
+    }
+}
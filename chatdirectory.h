@@ -0,0 +1,92 @@
+#ifndef CHATDIRECTORY_H
+#define CHATDIRECTORY_H
+
+#include <functional>
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "types/chat.h"
+#include "types/user.h"
+#include "types/message.h"
+
+namespace Telegram {
+
+class Bot;
+
+/**
+ * Cache for Chat and User objects.
+ * It is filled passively from the chats and users contained in incoming messages and from
+ * getChat/getMe results. Entries are kept in a LRU cache and expire after ttl seconds.
+ * Concurrent lookups for the same id share one getChat request.
+ */
+class ChatDirectory : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void(bool ok, const Chat &chat)> ChatCallback;
+    typedef std::function<void(bool ok, const User &user)> UserCallback;
+
+    /**
+     * @param bot - used for getChat/getMe requests and as source of updates
+     * @param capacity - maximum number of chats and users kept each
+     * @param ttl - seconds until a cached entry is considered stale
+     * @param parent
+     */
+    ChatDirectory(Bot *bot, int capacity = 10000, quint32 ttl = 600, QObject *parent = 0);
+
+    /**
+     * Looks up chatId in the cache only.
+     * @return false if not cached or expired
+     */
+    bool cachedChat(const ChatId &chatId, Chat &chat);
+    bool cachedUser(qint32 userId, User &user);
+
+    /**
+     * Calls fn with the cached chat or requests it via getChat. fn might be called synchronously.
+     */
+    void chat(const ChatId &chatId, ChatCallback fn);
+
+    /**
+     * Calls fn with the bot's own user, requested via getMe once per ttl.
+     */
+    void me(UserCallback fn);
+
+    void insert(const Chat &chat);
+    void insert(const User &user);
+    void invalidate(const ChatId &chatId);
+
+public slots:
+    /**
+     * Adds the chat and users of message. Connected to Bot::message in the constructor.
+     */
+    void observe(uint64_t updateId, Message message);
+
+signals:
+    void chatAvailable(const Chat &chat);
+
+private:
+    template <typename T> struct Cached {
+        Cached(const T &v, qint64 t) : value(v), fetched(t) {}
+        T value;
+        qint64 fetched; // msec of m_clock
+    };
+
+    bool isFresh(qint64 fetched) const;
+
+    Bot *m_bot;
+    qint64 m_ttl; // msec
+    QElapsedTimer m_clock;
+    QCache<ChatId, Cached<Chat> > m_chats;
+    QCache<qint32, Cached<User> > m_users;
+    QHash<ChatId, QVector<ChatCallback> > m_pendingChats;
+    User m_me;
+    qint64 m_meFetched;
+    QVector<UserCallback> m_pendingMe;
+};
+
+}
+
+#endif // CHATDIRECTORY_H
@@ -0,0 +1,59 @@
+#include "conversation.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+Conversation::Conversation(SessionStore *store, QObject *parent) :
+    QObject(parent),
+    m_store(store)
+{
+}
+
+Conversation &Conversation::on(int state, StateHandler handler)
+{
+    if (state == End)
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "no handler possible for End state";
+    else
+        m_handlers.insert(state, handler);
+    return *this;
+}
+
+void Conversation::begin(const ChatId &chatId, int state, const QVariantMap &data)
+{
+    Session session;
+    session.state = state;
+    session.data = data;
+    m_store->insert(chatId, session);
+}
+
+void Conversation::end(const ChatId &chatId)
+{
+    m_store->remove(chatId);
+}
+
+bool Conversation::dispatch(const Message &message)
+{
+    const ChatId chatId(message.chat.id);
+
+    // the handler runs without holding the shard lock, so it may use the store itself
+    Session session;
+    if (!m_store->get(chatId, session) || session.state == End)
+        return false;
+
+    auto it = m_handlers.constFind(session.state);
+    if (it == m_handlers.constEnd()) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "no handler for state" << session.state;
+        return false;
+    }
+
+    const int oldState = session.state;
+    session.state = it.value()(message, session);
+    if (session.state == End)
+        m_store->remove(chatId);
+    else
+        m_store->insert(chatId, session);
+
+    if (oldState != session.state)
+        emit stateChanged(chatId, oldState, session.state);
+    return true;
+}
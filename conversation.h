@@ -0,0 +1,58 @@
+#ifndef CONVERSATION_H
+#define CONVERSATION_H
+
+#include <functional>
+#include <QObject>
+#include <QHash>
+
+#include "sessionstore.h"
+#include "types/message.h"
+
+namespace Telegram {
+
+/**
+ * State machine for multi step dialogs.
+ * Each chat with a running conversation has a Session with a state != End in the SessionStore.
+ * Incoming messages of that chat are passed to the handler registered for its state, the handler
+ * returns the next state. Returning End finishes the conversation and removes the session.
+ *
+ *     conversation.on(AskName, [](const Message &m, Session &s) { s.data["name"] = m.string; return AskAge; });
+ *     router.setConversation(&conversation);
+ */
+class Conversation : public QObject
+{
+    Q_OBJECT
+public:
+    enum { End = 0 };
+
+    typedef std::function<int(const Message &message, Session &session)> StateHandler;
+
+    explicit Conversation(SessionStore *store, QObject *parent = 0);
+
+    Conversation &on(int state, StateHandler handler);
+
+    /**
+     * Starts (or restarts) a conversation for chatId in state.
+     */
+    void begin(const ChatId &chatId, int state, const QVariantMap &data = QVariantMap());
+    void end(const ChatId &chatId);
+
+    /**
+     * Passes message to the handler of its chat's current state.
+     * @return false if the chat has no running conversation
+     */
+    bool dispatch(const Message &message);
+
+    SessionStore *store() const { return m_store; }
+
+signals:
+    void stateChanged(const ChatId &chatId, int oldState, int newState);
+
+private:
+    SessionStore *m_store;
+    QHash<int, StateHandler> m_handlers;
+};
+
+}
+
+#endif // CONVERSATION_H
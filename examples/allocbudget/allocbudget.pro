@@ -0,0 +1,5 @@
+TARGET = allocbudget
+
+SOURCES += main.cpp
+
+include(../common/example.pri)
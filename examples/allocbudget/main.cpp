@@ -0,0 +1,136 @@
+#include <functional>
+#include <QCoreApplication>
+#include <QStringList>
+#include "qttelegrambot.h"
+#define CHECKUTIL_COUNT_ALLOCATIONS
+#include "checkutil.h"
+
+// Counts heap allocations and bytes of the hot paths and fails if one of them exceeds its budget.
+// The budgets are estimates that were not measured yet; until they are replaced by --report
+// numbers of a real build this is not part of `make check`. Run with --report to print the
+// measured numbers and the budgets they suggest (measured + 10%) without failing.
+// Only glibc builds count all allocations, elsewhere the check is skipped.
+
+struct Budget
+{
+    const char *name;
+    quint64 allocations; // per operation
+    quint64 bytes;
+    std::function<void()> operation;
+};
+
+static QByteArray getUpdatesResponse(int size)
+{
+    QJsonArray result;
+    for (int i = 0; i < size; ++i) {
+        QJsonObject u;
+        u.insert("update_id", i);
+        u.insert("message", message(i, i % 2, i % 3));
+        result.append(u);
+    }
+    QJsonObject response;
+    response.insert("ok", true);
+    response.insert("result", result);
+    return QJsonDocument(response).toJson(QJsonDocument::Compact);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    if (!s_countsAllAllocations) {
+        // operator new alone misses the allocations of Qt containers, the budgets would mean nothing
+        qInfo("skipped: allocations are only counted with glibc");
+        return 0;
+    }
+    const bool report = a.arguments().contains("--report");
+    const int rounds = 100;
+
+    const QJsonObject textMessage = parsed(message(1, false, 0));
+    const QJsonObject photoMessage = parsed(message(2, true, 0));
+    const QJsonObject replyMessage = parsed(message(3, false, 2));
+    const QJsonObject callbackUpdate = parsed(callbackQuery(4));
+
+    Telegram::Networking net("123456:token");
+    Telegram::ParameterList list;
+    list.insert("chat_id", Telegram::HttpParameter(QString("-1001234567890")));
+    list.insert("text", Telegram::HttpParameter(QString("some text of a message")));
+    list.insert("parse_mode", Telegram::HttpParameter(QString("Markdown")));
+    list.insert("reply_to_message_id", Telegram::HttpParameter(QString("42")));
+
+    Telegram::RequestBuilder upload;
+    upload.add("chat_id", Telegram::ChatId(-1001234567890ll));
+    upload.add("caption", QString("some caption"));
+    upload.addFile("photo", QByteArray(64 * 1024, 'x'), "image/jpeg", "photo.jpg");
+
+    const QByteArray batch = getUpdatesResponse(50);
+    Telegram::UpdateStreamParser parser;
+
+    quint64 ids = 0;
+    const Budget budgets[] = {
+        { "Message text", 60, 3 * 1024, [&]() {
+              Telegram::Message m(textMessage);
+              ids += m.id;
+          } },
+        { "Message photo", 80, 4 * 1024, [&]() {
+              Telegram::Message m(photoMessage);
+              ids += m.id;
+          } },
+        { "Message with replies", 200, 11 * 1024, [&]() {
+              Telegram::Message m(replyMessage);
+              ids += m.id;
+          } },
+        { "Update callback_query", 90, 5 * 1024, [&]() {
+              Telegram::Update u(callbackUpdate);
+              ids += u.id;
+          } },
+        { "sendMessage request", 10, 1024, [&]() {
+              Telegram::Api::SendMessage request(Telegram::ChatId(-1001234567890ll), "some text of a message");
+              request.disableWebPagePreview = true;
+              request.replyToMessageId = 42;
+              ids += Telegram::Api::encode(request).encoded().size();
+          } },
+        { "parameterListToString", 12, 1536, [&]() {
+              ids += net.parameterListToString(list).size();
+          } },
+        { "multipart upload 64 KiB", 6, 72 * 1024, [&]() {
+              const QByteArray boundary = upload.multipartBoundary();
+              ids += upload.multipart(boundary).size();
+          } },
+        { "getUpdates batch of 50", 10000, 512 * 1024, [&]() {
+              // as Bot::internalGetUpdates
+              parser.reset();
+              parser.feed(batch.constData(), batch.size(), [&](const QJsonObject &obj) {
+                  Telegram::Update u(obj);
+                  ids += u.message.id;
+              });
+          } },
+    };
+
+    int failed = 0;
+    for (const Budget &budget : budgets) {
+        // first run fills caches and static data of Qt, that is not what is measured
+        budget.operation();
+
+        startCounting();
+        for (int r = 0; r < rounds; ++r)
+            budget.operation();
+        const AllocationCount count = stopCounting();
+
+        const quint64 allocations = (count.allocations + rounds - 1) / rounds;
+        const quint64 bytes = (count.bytes + rounds - 1) / rounds;
+        const bool ok = allocations <= budget.allocations && bytes <= budget.bytes;
+        if (!ok)
+            ++failed;
+        qInfo("%-4s %-26s %6llu allocations (budget %6llu) %8llu bytes (budget %8llu)",
+              ok ? "ok" : "OVER", budget.name, allocations, budget.allocations, bytes, budget.bytes);
+        if (report)
+            qInfo("     %-26s suggested budget %llu, %llu", budget.name, allocations + (allocations + 9) / 10, bytes + (bytes + 9) / 10);
+    }
+    qInfo("checksum %llu", ids);
+
+    if (failed && !report) {
+        qCritical("%d operations over budget", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,8 @@
+TARGET = awaitcheck
+CONFIG += c++2a testcase
+# gcc 10 needs coroutines enabled explicitly even with -std=c++2a
+*-g++*: QMAKE_CXXFLAGS += -fcoroutines
+
+SOURCES += main.cpp
+
+include(../common/example.pri)
@@ -0,0 +1,79 @@
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include "qttelegrambot.h"
+#include "awaitable.h"
+#include "checkutil.h"
+#include "fakeapiserver.h"
+
+// Runs a coroutine of awaitable.h against the fake local Bot API server. This example is built as
+// C++20, the library as C++11. `make check` runs it, it exits with 1 if a check failed.
+
+#ifndef QTTELEGRAMBOT_COROUTINES
+#error "awaitcheck needs a compiler and standard library with C++20 coroutines"
+#endif
+
+struct Outcome
+{
+    Outcome() : meOk(false), sentOk(false), messageId(0), chatOk(true), done(false) {}
+
+    bool meOk;
+    QString username;
+    bool sentOk;
+    qint32 messageId;
+    bool chatOk;
+    bool done;
+};
+
+static Telegram::Task run(Telegram::Bot *bot, Telegram::CancelToken *token, Outcome *outcome)
+{
+    auto me = co_await Telegram::getMe(bot);
+    outcome->meOk = me.ok;
+    outcome->username = me.value.username;
+    if (me.ok) {
+        auto sent = co_await Telegram::sendMessage(bot, Telegram::ChatId(me.value.id), "hello");
+        outcome->sentOk = sent.ok;
+        outcome->messageId = sent.value.id;
+
+        // the server never answers getChat, the request is only finished by the cancel
+        auto chat = co_await Telegram::getChat(bot, Telegram::ChatId(me.value.id), token);
+        outcome->chatOk = chat.ok;
+    }
+    outcome->done = true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTemporaryDir dir;
+    const QString path = dir.path() + "/bot-api";
+
+    bool stalled = false;
+    FakeApiServer server(path);
+    server.setResponder([&](QLocalSocket *, const QByteArray &requestLine) {
+        if (!requestLine.contains("/getChat"))
+            return false;
+        stalled = true;
+        return true;
+    });
+    CHECK(server.listen(), "listen");
+
+    Telegram::Bot *bot = new Telegram::Bot("0:awaitcheck");
+    bot->setLocalServer(path);
+
+    Telegram::CancelToken token;
+    Outcome outcome;
+    run(bot, &token, &outcome);
+    CHECK(!outcome.done, "coroutine suspended at the first request");
+
+    CHECK(waitFor([&]() { return stalled; }, 5000), "getChat reached the server");
+    CHECK(outcome.meOk && outcome.username == "selfcheck_bot", "getMe");
+    CHECK(outcome.sentOk && outcome.messageId == 1, "sendMessage");
+    CHECK(!outcome.done, "waiting for getChat");
+
+    token.cancel();
+    CHECK(waitFor([&]() { return outcome.done; }, 5000), "cancel resumes the coroutine");
+    CHECK(!outcome.chatOk, "canceled request is not ok");
+
+    delete bot;
+    return checkResult();
+}
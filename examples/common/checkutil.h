@@ -0,0 +1,220 @@
+#ifndef CHECKUTIL_H
+#define CHECKUTIL_H
+
+#include <cstdlib>
+#include <new>
+#include <QtGlobal>
+#include <QString>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+// Shared by the checks and benchmarks of the examples, each of them is a single source file.
+
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond, what) \
+    do { if (!(cond)) { ++checkFailures(); qCritical("FAIL %s: %s", what, #cond); } } while (0)
+
+/**
+ * @return exit code for main, 1 if a check failed
+ */
+inline int checkResult()
+{
+    if (checkFailures()) {
+        qCritical("%d checks failed", checkFailures());
+        return 1;
+    }
+    qInfo("all checks passed");
+    return 0;
+}
+
+// xorshift, reproducible across runs and platforms
+inline quint32 &randomState()
+{
+    static quint32 state = 0x9e3779b9;
+    return state;
+}
+
+inline void seedRandom(quint32 seed)
+{
+    randomState() = seed ? seed : 1;
+}
+
+inline quint32 next()
+{
+    quint32 &s = randomState();
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+#ifdef CHECKUTIL_COUNT_ALLOCATIONS
+// Counts heap allocations of the calling thread between startCounting() and stopCounting().
+// Define CHECKUTIL_COUNT_ALLOCATIONS before including this header in exactly one program.
+
+struct AllocationCount
+{
+    quint64 allocations;
+    quint64 bytes;
+};
+
+static thread_local bool t_counting = false;
+static thread_local AllocationCount t_count = { 0, 0 };
+
+static inline void countAllocation(std::size_t size)
+{
+    if (t_counting) {
+        ++t_count.allocations;
+        t_count.bytes += size;
+    }
+}
+
+inline void startCounting()
+{
+    t_count.allocations = 0;
+    t_count.bytes = 0;
+    t_counting = true;
+}
+
+inline AllocationCount stopCounting()
+{
+    t_counting = false;
+    return t_count;
+}
+
+#if defined(__GLIBC__)
+// glibc: interpose malloc itself, Qt containers and strings allocate through it
+static const bool s_countsAllAllocations = true;
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t n, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+void __libc_free(void *p);
+
+void *malloc(std::size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t n, std::size_t size)
+{
+    countAllocation(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, std::size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(p, size);
+}
+
+void free(void *p)
+{
+    __libc_free(p);
+}
+}
+#else
+// elsewhere only operator new is counted, allocations of Qt containers are missed
+static const bool s_countsAllAllocations = false;
+
+void *operator new(std::size_t size)
+{
+    countAllocation(size);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+#endif // CHECKUTIL_COUNT_ALLOCATIONS
+
+// Bot API objects as the server sends them
+
+/**
+ * @return obj after a round trip through json text, as the bot parses it
+ */
+inline QJsonObject parsed(const QJsonObject &obj)
+{
+    return QJsonDocument::fromJson(QJsonDocument(obj).toJson(QJsonDocument::Compact)).object();
+}
+
+inline QJsonObject user(int id)
+{
+    QJsonObject u;
+    u.insert("id", 1000 + id);
+    u.insert("first_name", "First");
+    u.insert("username", "someuser");
+    return u;
+}
+
+inline QJsonObject chat(int id)
+{
+    QJsonObject c;
+    c.insert("id", -100 - id);
+    c.insert("type", "group");
+    c.insert("title", "Some group");
+    return c;
+}
+
+/**
+ * @param depth - length of the chain of replied to messages, they alternate between text and photo
+ */
+inline QJsonObject message(int id, bool withPhoto, int depth)
+{
+    QJsonObject m;
+    m.insert("message_id", id);
+    m.insert("date", 1500000000 + id);
+    m.insert("from", user(id));
+    m.insert("chat", chat(id));
+    if (withPhoto) {
+        QJsonArray photo;
+        for (int i = 0; i < 3; ++i) {
+            QJsonObject size;
+            size.insert("file_id", "AgADBAADv6cxG" + QString::number(i));
+            size.insert("width", 90 << i);
+            size.insert("height", 60 << i);
+            size.insert("file_size", 1000 << i);
+            photo.append(size);
+        }
+        m.insert("photo", photo);
+    } else {
+        m.insert("text", "some text of a message");
+    }
+    if (depth)
+        m.insert("reply_to_message", message(id - 1, !withPhoto, depth - 1));
+    return m;
+}
+
+inline QJsonObject callbackQuery(int id)
+{
+    QJsonObject q;
+    q.insert("id", QString::number(4382000000000ll + id));
+    q.insert("from", user(id));
+    q.insert("message", message(id, false, 0));
+    q.insert("chat_instance", "-8329472398472");
+    q.insert("data", "AQID");
+
+    QJsonObject u;
+    u.insert("update_id", id);
+    u.insert("callback_query", q);
+    return u;
+}
+
+#endif // CHECKUTIL_H
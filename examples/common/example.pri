@@ -0,0 +1,16 @@
+# Settings shared by the examples, include after setting TARGET.
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD
+HEADERS += \
+    $$PWD/checkutil.h \
+    $$PWD/fakeapiserver.h
+
+include($$PWD/../../QtTelegramBot.pri)
@@ -0,0 +1,116 @@
+#ifndef FAKEAPISERVER_H
+#define FAKEAPISERVER_H
+
+#include <functional>
+#include <QEventLoop>
+#include <QHash>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+
+// runs the event loop until done() or the timeout
+inline bool waitFor(const std::function<bool()> &done, int timeout)
+{
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() { if (done()) loop.quit(); });
+    poll.start(5);
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+    if (!done())
+        loop.exec();
+    return done();
+}
+
+/**
+ * Bot API server on a Unix domain socket that answers every getUpdates with no updates, getMe
+ * with a user, sendMessage with the sent message and anything else with true. stopDuringPoll()
+ * makes it close the server and drop the connection on the next poll instead of answering.
+ */
+class FakeApiServer
+{
+public:
+    /**
+     * Answers a request itself, with any bytes or by closing the connection.
+     * @return false to let the server answer as usual
+     */
+    typedef std::function<bool(QLocalSocket *socket, const QByteArray &requestLine)> Responder;
+
+    explicit FakeApiServer(const QString &path) : m_path(path), m_polls(0), m_connections(0), m_sent(0), m_stopDuringPoll(false)
+    {
+        QObject::connect(&m_server, &QLocalServer::newConnection, [this]() {
+            while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+                ++m_connections;
+                QObject::connect(socket, &QLocalSocket::readyRead, socket, [this, socket]() { read(socket); });
+            }
+        });
+    }
+
+    bool listen()
+    {
+        QLocalServer::removeServer(m_path);
+        return m_server.listen(m_path);
+    }
+    void stopDuringPoll() { m_stopDuringPoll = true; }
+    bool isListening() const { return m_server.isListening(); }
+    int polls() const { return m_polls; }
+    int connections() const { return m_connections; }
+    void setResponder(const Responder &responder) { m_responder = responder; }
+
+private:
+    void read(QLocalSocket *socket)
+    {
+        QByteArray &in = m_in[socket];
+        in += socket->readAll();
+        for (;;) {
+            const int headerEnd = in.indexOf("\r\n\r\n");
+            if (headerEnd < 0)
+                return;
+            int length = 0;
+            const int cl = in.toLower().indexOf("content-length:");
+            if (cl >= 0 && cl < headerEnd)
+                length = in.mid(cl + 15, in.indexOf("\r\n", cl) - cl - 15).trimmed().toInt();
+            if (in.size() < headerEnd + 4 + length)
+                return;
+            const QByteArray requestLine = in.left(in.indexOf("\r\n"));
+            in.remove(0, headerEnd + 4 + length);
+
+            if (m_responder && m_responder(socket, requestLine)) {
+                if (socket->state() != QLocalSocket::ConnectedState) {
+                    m_in.remove(socket);
+                    return;
+                }
+                continue;
+            }
+
+            QByteArray body = "{\"ok\":true,\"result\":true}";
+            if (requestLine.contains("/getUpdates")) {
+                ++m_polls;
+                if (m_stopDuringPoll) {
+                    m_stopDuringPoll = false;
+                    m_in.remove(socket);
+                    m_server.close();
+                    socket->abort();
+                    return;
+                }
+                body = "{\"ok\":true,\"result\":[]}";
+            } else if (requestLine.contains("/getMe")) {
+                body = "{\"ok\":true,\"result\":{\"id\":1,\"is_bot\":true,\"first_name\":\"selfcheck\",\"username\":\"selfcheck_bot\"}}";
+            } else if (requestLine.contains("/sendMessage")) {
+                body = "{\"ok\":true,\"result\":{\"message_id\":" + QByteArray::number(++m_sent)
+                        + ",\"date\":1500000000,\"chat\":{\"id\":1,\"type\":\"private\"},\"text\":\"sent\"}}";
+            }
+            socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+        }
+    }
+
+    QLocalServer m_server;
+    QString m_path;
+    QHash<QLocalSocket *, QByteArray> m_in;
+    int m_polls;
+    int m_connections;
+    int m_sent;
+    bool m_stopDuringPoll;
+    Responder m_responder;
+};
+
+#endif // FAKEAPISERVER_H
@@ -0,0 +1,6 @@
+TARGET = encodecheck
+CONFIG += testcase
+
+SOURCES += main.cpp
+
+include(../common/example.pri)
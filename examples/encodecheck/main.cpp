@@ -0,0 +1,126 @@
+#include <cstring>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QVector>
+#include "qttelegrambot.h"
+#include "checkutil.h"
+
+// Fuzzes the form encoding of RequestBuilder and measures its throughput. `make check` runs it,
+// it exits with 1 if a check failed.
+
+static QByteArray randomValue(int maxLength)
+{
+    // mostly characters with a meaning in urls and forms, the rest any byte
+    static const char special[] = " +&=#%?/;:@*-._~\r\n\"'";
+    QByteArray ret(int(next() % (maxLength + 1)), Qt::Uninitialized);
+    for (int i = 0; i < ret.size(); ++i) {
+        const quint32 r = next();
+        switch (r % 4) {
+        case 0: ret[i] = special[(r >> 8) % (sizeof(special) - 1)]; break;
+        case 1: ret[i] = char('a' + (r >> 8) % 26); break;
+        default: ret[i] = char(r >> 8); break;
+        }
+    }
+    return ret;
+}
+
+static QByteArray formDecode(QByteArray value)
+{
+    return QByteArray::fromPercentEncoding(value.replace('+', ' '));
+}
+
+static bool isFormSafe(const QByteArray &encoded)
+{
+    for (int i = 0; i < encoded.size(); ++i) {
+        const char c = encoded.at(i);
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("*-._+%", c)))
+            return false;
+    }
+    return true;
+}
+
+static void fuzzEncode(int rounds)
+{
+    for (int r = 0; r < rounds; ++r) {
+        const QByteArray value = randomValue(300);
+        const QByteArray encoded = Telegram::RequestBuilder::percentEncode(value);
+        CHECK(encoded.size() == Telegram::RequestBuilder::encodedLength(value.constData(), value.size()), "encodedLength");
+        CHECK(isFormSafe(encoded), "output alphabet");
+        CHECK(formDecode(encoded) == value, "round trip");
+
+        // arbitrary slices through the raw interface, the output must end exactly at the computed length
+        const int offset = value.isEmpty() ? 0 : int(next() % value.size());
+        const int length = int(next() % (value.size() - offset + 1));
+        const int expected = Telegram::RequestBuilder::encodedLength(value.constData() + offset, length);
+        QByteArray out(expected + 16, '\xAA');
+        char *end = Telegram::RequestBuilder::percentEncode(value.constData() + offset, length, out.data());
+        CHECK(end - out.constData() == expected, "slice length");
+        CHECK(out.mid(expected) == QByteArray(16, '\xAA'), "slice overrun");
+        CHECK(formDecode(out.left(expected)) == value.mid(offset, length), "slice round trip");
+    }
+}
+
+static void fuzzBuilder(int rounds)
+{
+    for (int r = 0; r < rounds; ++r) {
+        const QByteArray a = randomValue(64);
+        const QByteArray b = randomValue(64);
+        Telegram::RequestBuilder params;
+        params.add("a", a);
+        params.add("b", b);
+        const QList<QByteArray> pairs = params.encoded().split('&');
+        CHECK(pairs.size() == 2, "field separation");
+        if (pairs.size() == 2) {
+            CHECK(formDecode(pairs.at(0).mid(2)) == a, "first field");
+            CHECK(formDecode(pairs.at(1).mid(2)) == b, "second field");
+        }
+
+        // pre-encoded values end up decoded in multipart bodies
+        Telegram::RequestBuilder upload;
+        upload.addEncoded("text", Telegram::RequestBuilder::percentEncode(a));
+        upload.addFile("document", b, "application/octet-stream", "b.bin");
+        const QByteArray boundary = upload.multipartBoundary();
+        const QByteArray body = upload.multipart(boundary);
+        CHECK(body.contains("name=\"text\"\r\n\r\n" + a + "\r\n--" + boundary), "multipart encoded value");
+        CHECK(body.contains("\r\n\r\n" + b + "\r\n--" + boundary + "--"), "multipart file");
+    }
+
+    Telegram::RequestBuilder spaces;
+    spaces.addEncoded("text", Telegram::RequestBuilder::percentEncode("a b+c"));
+    CHECK(spaces.multipart("X").contains("\r\n\r\na b+c\r\n"), "space in encoded multipart value");
+}
+
+static void throughput(const char *name, const QByteArray &value, int rounds)
+{
+    QByteArray out(Telegram::RequestBuilder::encodedLength(value.constData(), value.size()), Qt::Uninitialized);
+    QElapsedTimer timer;
+    timer.start();
+    for (int r = 0; r < rounds; ++r)
+        Telegram::RequestBuilder::percentEncode(value.constData(), value.size(), out.data());
+    const qint64 ns = timer.nsecsElapsed();
+    qInfo("%-10s %8.1f MB/s", name, double(value.size()) * rounds * 1000.0 / double(ns));
+}
+
+static QByteArray repeated(const QByteArray &text, int size)
+{
+    QByteArray ret;
+    while (ret.size() < size)
+        ret += text;
+    ret.truncate(size);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    fuzzEncode(20000);
+    fuzzBuilder(2000);
+
+    const int size = 64 * 1024;
+    throughput("ids", repeated("1234567890abcdefABCDEF_-", size), 2000);
+    throughput("text", repeated("Some text, with spaces & punctuation! ", size), 2000);
+    throughput("utf-8", repeated(QString::fromUtf8("Привет, как дела? ").toUtf8(), size), 2000);
+
+    return checkResult();
+}
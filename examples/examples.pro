@@ -1,3 +1,9 @@
 TEMPLATE = subdirs
 SUBDIRS += \
-    echo
+    echo \
+    parsebench \
+    sendbench \
+    encodecheck \
+    selfcheck \
+    awaitcheck \
+    allocbudget
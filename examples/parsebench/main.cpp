@@ -0,0 +1,77 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include "qttelegrambot.h"
+#define CHECKUTIL_COUNT_ALLOCATIONS
+#include "checkutil.h"
+
+// Counts heap allocations and time of parsing getUpdates batches with and without interning.
+// "group" is a busy group, 5 users writing into one chat, so interning mostly hits. "distinct"
+// has a new user and chat in every update, with a table of one entry every lookup misses.
+
+static QList<QJsonObject> groupBatch(int size)
+{
+    QList<QJsonObject> updates;
+    for (int i = 0; i < size; ++i) {
+        QJsonObject m = message(i, i % 2, 0);
+        m.insert("from", user(i % 5));
+        m.insert("chat", chat(0));
+        QJsonObject u;
+        u.insert("update_id", i);
+        u.insert("message", m);
+        updates.append(parsed(u));
+    }
+    return updates;
+}
+
+static QList<QJsonObject> distinctBatch(int size)
+{
+    QList<QJsonObject> updates;
+    for (int i = 0; i < size; ++i) {
+        QJsonObject u;
+        u.insert("update_id", i);
+        u.insert("message", message(i, i % 2, 0));
+        updates.append(parsed(u));
+    }
+    return updates;
+}
+
+static void run(const char *name, const QList<QJsonObject> &updates, int rounds)
+{
+    const quint64 hits = Telegram::Interner::hits();
+    quint64 ids = 0;
+    QElapsedTimer timer;
+    startCounting();
+    timer.start();
+    for (int r = 0; r < rounds; ++r) {
+        foreach (const QJsonObject &obj, updates) {
+            Telegram::Update u(obj);
+            ids += u.message.id;
+        }
+    }
+    const qint64 ns = timer.nsecsElapsed();
+    const double count = double(rounds) * updates.size();
+    const double perUpdate = double(stopCounting().allocations) / count;
+    qInfo("%-18s %6.1f allocations/update %8.0f ns/update %5.2f hits/update (%llu)", name, perUpdate,
+          double(ns) / count, double(Telegram::Interner::hits() - hits) / count, ids);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    const QList<QJsonObject> group = groupBatch(50);
+    const QList<QJsonObject> distinct = distinctBatch(50);
+    const int rounds = 2000;
+
+    run("group heap", group, rounds);
+    run("distinct heap", distinct, rounds);
+
+    Telegram::Interner::setEnabled(true);
+    run("group interned", group, rounds);
+
+    Telegram::Interner::setEnabled(false);
+    Telegram::Interner::setEnabled(true, 1);
+    run("distinct interned", distinct, rounds);
+    Telegram::Interner::setEnabled(false);
+    return 0;
+}
@@ -0,0 +1,5 @@
+TARGET = parsebench
+
+SOURCES += main.cpp
+
+include(../common/example.pri)
@@ -0,0 +1,260 @@
+#include <limits>
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <QNetworkReply>
+#include <QTemporaryDir>
+#include <QVector>
+#include "qttelegrambot.h"
+#include "localtransport.h"
+#include "checkutil.h"
+#include "fakeapiserver.h"
+
+// Checks of library parts that can run without a Telegram server, a fake local Bot API server
+// stands in for it where needed. `make check` runs it, it exits with 1 if a check failed.
+
+struct Field
+{
+    enum Kind { UInt, Int, Bool, String, Bytes } kind;
+    quint64 u;
+    qint64 i;
+    QByteArray bytes;
+};
+
+static Field randomField()
+{
+    static const quint64 uints[] = { 0, 1, 127, 128, 16383, 16384, std::numeric_limits<quint64>::max() };
+    static const qint64 ints[] = { 0, -1, 1, -64, 64, std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max() };
+    Field f;
+    f.kind = Field::Kind(next() % 5);
+    f.u = (next() % 2) ? uints[next() % 7] : (quint64(next()) << 32 | next()) >> (next() % 64);
+    f.i = (next() % 2) ? ints[next() % 7] : qint64(quint64(next()) << 32 | next()) >> (next() % 64);
+    if (f.kind == Field::String)
+        f.bytes = QString::fromUtf8("ä€x😀").left(int(next() % 6)).toUtf8();
+    else if (f.kind == Field::Bytes)
+        for (int n = int(next() % 8); n > 0; --n)
+            f.bytes += char(next());
+    return f;
+}
+
+static void write(Telegram::CallbackDataWriter &w, const Field &f)
+{
+    switch (f.kind) {
+    case Field::UInt: w.addUInt(f.u); break;
+    case Field::Int: w.addInt(f.i); break;
+    case Field::Bool: w.addBool(f.u & 1); break;
+    case Field::String: w.addString(QString::fromUtf8(f.bytes)); break;
+    case Field::Bytes: w.addBytes(f.bytes); break;
+    }
+}
+
+static bool readMatches(Telegram::CallbackDataReader &r, const Field &f)
+{
+    switch (f.kind) {
+    case Field::UInt: return r.readUInt() == f.u;
+    case Field::Int: return r.readInt() == f.i;
+    case Field::Bool: return r.readBool() == bool(f.u & 1);
+    case Field::String: return r.readString() == QString::fromUtf8(f.bytes);
+    case Field::Bytes: return r.readBytes() == f.bytes;
+    }
+    return false;
+}
+
+static void checkCallbackData(int rounds)
+{
+    for (int round = 0; round < rounds; ++round) {
+        // as many fields as fit
+        QVector<Field> fields;
+        Telegram::CallbackDataWriter w;
+        for (;;) {
+            const Field f = randomField();
+            Telegram::CallbackDataWriter probe(w);
+            write(probe, f);
+            if (!probe.fits())
+                break;
+            w = probe;
+            fields.append(f);
+        }
+        const QString encoded = w.encoded();
+        CHECK(!encoded.isEmpty() && encoded.size() <= Telegram::CallbackDataWriter::MaxEncodedSize, "encoded size");
+
+        Telegram::CallbackDataReader r(encoded);
+        bool same = true;
+        foreach (const Field &f, fields)
+            same = readMatches(r, f) && same;
+        CHECK(same && r.isValid() && r.atEnd(), "round trip");
+
+        // truncated data always loses part of the last field
+        const int cut = int(next() % encoded.size());
+        Telegram::CallbackDataReader truncated(encoded.left(cut));
+        foreach (const Field &f, fields)
+            readMatches(truncated, f);
+        CHECK(!truncated.isValid(), "truncated");
+
+        // a forged character anywhere invalidates the data
+        QString forged = encoded;
+        forged[int(next() % forged.size())] = QChar(QLatin1Char("+/=. %\n"[next() % 7]));
+        Telegram::CallbackDataReader bad(forged);
+        bad.readUInt();
+        CHECK(!bad.isValid(), "forged character");
+    }
+
+    // random input must never crash or read out of bounds, whatever it decodes to
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    for (int round = 0; round < rounds; ++round) {
+        QString forged;
+        for (int n = int(next() % 70); n > 0; --n)
+            forged += QLatin1Char(alphabet[next() % 64]);
+        Telegram::CallbackDataReader r(forged);
+        for (int n = 0; n < 20; ++n)
+            randomField().kind == Field::Bytes ? (void)r.readBytes() : (void)r.readInt();
+        CHECK(r.readBytes().size() <= forged.size(), "forged bytes bounded");
+    }
+
+    Telegram::CallbackDataWriter tooLarge;
+    tooLarge.addBytes(QByteArray(Telegram::CallbackDataWriter::MaxPackedSize, 'x'));
+    CHECK(!tooLarge.fits() && tooLarge.encoded().isEmpty(), "too large");
+    CHECK(!Telegram::CallbackDataReader(QString()).isValid(), "empty");
+    CHECK(!Telegram::CallbackDataReader(QString(65, QLatin1Char('A'))).isValid(), "too long");
+}
+
+static void checkLocalServerStop()
+{
+    QTemporaryDir dir;
+    const QString path = dir.path() + "/bot-api";
+
+    // a refused connection fails the reply from the event loop, after the caller tracked it
+    {
+        Telegram::LocalTransport transport(path);
+        QNetworkReply *reply = transport.get("/bot0:selfcheck/getMe");
+        CHECK(!reply->isFinished(), "refused connection reported asynchronously");
+        CHECK(waitFor([reply]() { return reply->isFinished(); }, 5000), "refused connection finishes");
+        CHECK(reply->error() != QNetworkReply::NoError, "refused connection fails");
+    }
+
+    FakeApiServer server(path);
+    CHECK(server.listen(), "listen");
+    Telegram::Bot *bot = new Telegram::Bot("0:selfcheck", true, 20, 0);
+    bot->setLocalServer(path);
+    CHECK(waitFor([&]() { return server.polls() >= 2; }, 5000), "polling");
+
+    // the poll in flight fails, the following ones can't connect at all
+    server.stopDuringPoll();
+    CHECK(waitFor([&]() { return !server.isListening(); }, 5000), "server stopped during a poll");
+    waitFor([]() { return false; }, 200);
+
+    int answered = 0;
+    bool getMeOk = true;
+    bot->asyncGetMe([&](bool ok, const Telegram::User &) { ++answered; getMeOk = ok; });
+    CHECK(waitFor([&]() { return answered == 1; }, 5000) && !getMeOk, "request fails while the server is down");
+
+    // polling and scheduled requests resume once the server is back
+    const int polls = server.polls();
+    CHECK(server.listen(), "listen again");
+    CHECK(waitFor([&]() { return server.polls() > polls; }, 5000), "polling resumes after the server was stopped");
+    bot->asyncGetMe([&](bool ok, const Telegram::User &) { ++answered; getMeOk = ok; });
+    CHECK(waitFor([&]() { return answered == 2; }, 5000) && getMeOk, "request succeeds after the server is back");
+
+    // returns once the poll in flight finished
+    delete bot;
+}
+
+static bool finish(QNetworkReply *reply)
+{
+    return waitFor([reply]() { return reply->isFinished(); }, 5000);
+}
+
+static void checkLocalTransport()
+{
+    QTemporaryDir dir;
+    const QString path = dir.path() + "/bot-api";
+    FakeApiServer server(path);
+    CHECK(server.listen(), "listen");
+    Telegram::LocalTransport transport(path);
+    transport.setMaxConnections(1);
+
+    // chunked body, split across writes and with a chunk extension
+    server.setResponder([](QLocalSocket *socket, const QByteArray &requestLine) {
+        if (!requestLine.contains("/chunked"))
+            return false;
+        socket->write("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel");
+        socket->flush();
+        QTimer::singleShot(20, socket, [socket]() { socket->write("lo\r\n6;ext=1\r\n world\r\n0\r\n\r\n"); });
+        return true;
+    });
+    QNetworkReply *reply = transport.get("/chunked");
+    CHECK(finish(reply), "chunked response finishes");
+    CHECK(reply->error() == QNetworkReply::NoError && reply->readAll() == "hello world", "chunked body");
+
+    // keep-alive: the next requests go over the same connection
+    reply = transport.get("/bot0:selfcheck/getMe");
+    CHECK(finish(reply) && reply->error() == QNetworkReply::NoError, "request after a chunked response");
+    reply = transport.post("/bot0:selfcheck/sendMessage", "application/x-www-form-urlencoded", "chat_id=1&text=a");
+    CHECK(finish(reply) && reply->error() == QNetworkReply::NoError && reply->readAll().startsWith("{\"ok\":true"), "post on a reused connection");
+    CHECK(server.connections() == 1, "connection reused");
+
+    // no Content-Length, the body ends with the connection
+    server.setResponder([](QLocalSocket *socket, const QByteArray &requestLine) {
+        if (!requestLine.contains("/untilClose"))
+            return false;
+        socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{\"ok\":");
+        socket->flush();
+        QTimer::singleShot(20, socket, [socket]() {
+            socket->write("true}");
+            socket->disconnectFromServer();
+        });
+        return true;
+    });
+    reply = transport.get("/untilClose");
+    CHECK(finish(reply), "response read until close finishes");
+    CHECK(reply->error() == QNetworkReply::NoError && reply->readAll() == "{\"ok\":true}", "body read until close");
+
+    // abort in the middle of the body drops the connection, the next request gets a new one
+    server.setResponder([](QLocalSocket *socket, const QByteArray &requestLine) {
+        if (!requestLine.contains("/slow"))
+            return false;
+        socket->write("HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n0123456789");
+        return true;
+    });
+    const int connections = server.connections();
+    reply = transport.get("/slow");
+    QObject::connect(reply, &QNetworkReply::readyRead, reply, [reply]() { reply->abort(); });
+    CHECK(finish(reply) && reply->error() == QNetworkReply::OperationCanceledError, "abort mid-body");
+    reply = transport.get("/bot0:selfcheck/getMe");
+    CHECK(finish(reply) && reply->error() == QNetworkReply::NoError, "request after an abort");
+    CHECK(server.connections() == connections + 2, "aborted connection not reused");
+
+    // the server drops a reused connection when the next request arrives: a GET is sent again,
+    // a POST fails because it may have been processed
+    QHash<QLocalSocket *, int> requests;
+    int posts = 0;
+    server.setResponder([&](QLocalSocket *socket, const QByteArray &requestLine) {
+        if (requestLine.startsWith("POST"))
+            ++posts;
+        if (++requests[socket] < 2)
+            return false;
+        socket->abort();
+        return true;
+    });
+    reply = transport.get("/bot0:selfcheck/getMe");
+    CHECK(finish(reply) && reply->error() == QNetworkReply::NoError, "first request on the connection answered");
+    const int beforeRetry = server.connections();
+    reply = transport.get("/bot0:selfcheck/getMe");
+    CHECK(finish(reply) && reply->error() == QNetworkReply::NoError, "GET retried on a new connection");
+    CHECK(server.connections() == beforeRetry + 1, "retry opened a new connection");
+    reply = transport.post("/bot0:selfcheck/sendMessage", "application/x-www-form-urlencoded", "chat_id=1&text=a");
+    CHECK(finish(reply) && reply->error() == QNetworkReply::RemoteHostClosedError, "POST not retried");
+    CHECK(posts == 1, "POST sent once");
+    server.setResponder(FakeApiServer::Responder());
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    seedRandom(0x2545f491);
+
+    checkCallbackData(5000);
+    checkLocalServerStop();
+    checkLocalTransport();
+
+    return checkResult();
+}
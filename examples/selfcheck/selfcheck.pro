@@ -0,0 +1,6 @@
+TARGET = selfcheck
+CONFIG += testcase
+
+SOURCES += main.cpp
+
+include(../common/example.pri)
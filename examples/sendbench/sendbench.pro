@@ -0,0 +1,5 @@
+TARGET = sendbench
+
+SOURCES += main.cpp
+
+include(../common/example.pri)
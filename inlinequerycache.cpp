@@ -0,0 +1,127 @@
+#include "inlinequerycache.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+InlineQueryCache::InlineQueryCache(Bot *bot, Builder builder, int capacity, quint32 ttl, QObject *parent) :
+    QObject(parent),
+    m_bot(bot),
+    m_builder(builder),
+    m_ttl(qint64(ttl) * 1000),
+    m_debounce(300),
+    m_cacheTime(-1),
+    m_personal(false),
+    m_pages(capacity),
+    m_flushTimer(new QTimer(this)),
+    m_hits(0),
+    m_misses(0),
+    m_abandoned(0)
+{
+    m_clock.start();
+    m_flushTimer->setSingleShot(true);
+    connect(m_flushTimer, &QTimer::timeout, this, &InlineQueryCache::flushPending);
+    connect(m_bot, &Bot::inlineQuery, this, &InlineQueryCache::handle);
+}
+
+QString InlineQueryCache::normalize(const QString &text)
+{
+    return text.simplified().toCaseFolded();
+}
+
+QString InlineQueryCache::key(const QString &text, const InlineQuery &query) const
+{
+    // offsets are opaque to the client, separate them with a character a simplified query can't contain
+    QString k = text + QLatin1Char('\n') + query.offset;
+    if (m_personal)
+        k += QLatin1Char('\n') + QString::number(query.from.id);
+    return k;
+}
+
+void InlineQueryCache::handle(uint64_t updateId, InlineQuery query)
+{
+    Q_UNUSED(updateId);
+    const QString text = normalize(query.query);
+    const QString cacheKey = key(text, query);
+
+    Cached *c = m_pages.object(cacheKey);
+    if (c && m_clock.elapsed() - c->built < m_ttl) {
+        dropPending(query.from.id);
+        ++m_hits;
+        m_bot->answerInlineQuery(query.id, c->results, m_cacheTime, m_personal, c->nextOffset);
+        return;
+    }
+
+    if (!m_debounce || !query.offset.isEmpty()) {
+        dropPending(query.from.id);
+        answer(cacheKey, text, query);
+        return;
+    }
+
+    auto it = m_pending.find(query.from.id);
+    if (it != m_pending.end()) {
+        ++m_abandoned;
+        it.value().query = query;
+        it.value().due = m_clock.elapsed() + m_debounce;
+    } else {
+        Pending pending;
+        pending.query = query;
+        pending.due = m_clock.elapsed() + m_debounce;
+        m_pending.insert(query.from.id, pending);
+    }
+    scheduleFlush();
+}
+
+void InlineQueryCache::dropPending(qint32 userId)
+{
+    // an older keystroke of the user that is answered by this query
+    if (m_pending.remove(userId))
+        ++m_abandoned;
+}
+
+void InlineQueryCache::answer(const QString &cacheKey, const QString &text, const InlineQuery &query)
+{
+    ++m_misses;
+    const Page page = m_builder(text, query.offset, query);
+    const QByteArray results = QJsonDocument(page.results).toJson(QJsonDocument::Compact);
+    m_pages.insert(cacheKey, new Cached(results, page.nextOffset, m_clock.elapsed()));
+    m_bot->answerInlineQuery(query.id, results, m_cacheTime, m_personal, page.nextOffset);
+}
+
+void InlineQueryCache::scheduleFlush()
+{
+    qint64 next = -1;
+    for (auto it = m_pending.constBegin(); it != m_pending.constEnd(); ++it) {
+        if (next < 0 || it.value().due < next)
+            next = it.value().due;
+    }
+    if (next >= 0)
+        m_flushTimer->start(int(qMax<qint64>(0, next - m_clock.elapsed())));
+}
+
+void InlineQueryCache::flushPending()
+{
+    const qint64 now = m_clock.elapsed();
+    QList<InlineQuery> due;
+    for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if (it.value().due <= now) {
+            due.append(it.value().query);
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    foreach (const InlineQuery &query, due) {
+        const QString text = normalize(query.query);
+        const QString cacheKey = key(text, query);
+        // another user may have asked for the same text meanwhile
+        Cached *c = m_pages.object(cacheKey);
+        if (c && now - c->built < m_ttl) {
+            ++m_hits;
+            m_bot->answerInlineQuery(query.id, c->results, m_cacheTime, m_personal, c->nextOffset);
+        } else {
+            answer(cacheKey, text, query);
+        }
+    }
+    scheduleFlush();
+}
@@ -0,0 +1,113 @@
+#ifndef INLINEQUERYCACHE_H
+#define INLINEQUERYCACHE_H
+
+#include <functional>
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QTimer>
+#include <QJsonArray>
+#include <QElapsedTimer>
+
+#include "types/inlinequery.h"
+
+namespace Telegram {
+
+class Bot;
+
+/**
+ * Answers inline queries with result pages built by a callback and kept in a LRU cache.
+ * Pages are keyed by the normalized query text (simplified and case folded) and the offset, and
+ * expire after ttl seconds. Results are kept serialized, so a cache hit is answered without
+ * building or serializing anything.
+ * While typing, clients send a query per keystroke. A query that is not cached waits for the
+ * debounce interval; if the same user sends a newer query meanwhile, the older one is abandoned
+ * without being built. Requests for further pages are not debounced.
+ */
+class InlineQueryCache : public QObject
+{
+    Q_OBJECT
+public:
+    struct Page {
+        QJsonArray results; // at most 50
+        QString nextOffset; // empty if this is the last page
+    };
+
+    /**
+     * @param text - normalized query text
+     * @param offset - nextOffset of the previous page, empty for the first one
+     */
+    typedef std::function<Page(const QString &text, const QString &offset, const InlineQuery &query)> Builder;
+
+    /**
+     * @param bot - source of inline queries and used to answer them
+     * @param builder - builds the results of a page
+     * @param capacity - maximum number of pages kept
+     * @param ttl - seconds until a cached page is rebuilt
+     * @param parent
+     */
+    InlineQueryCache(Bot *bot, Builder builder, int capacity = 1000, quint32 ttl = 60, QObject *parent = 0);
+
+    /**
+     * @param msec - time a query waits for a newer one of the same user, 0 answers right away
+     */
+    void setDebounce(quint32 msec) { m_debounce = msec; }
+
+    /**
+     * Passed to answerInlineQuery.
+     * @param personal - results depend on the user, the cache key then includes the user id
+     */
+    void setAnswerOptions(qint32 cacheTime, bool personal) { m_cacheTime = cacheTime; m_personal = personal; }
+
+    void clear() { m_pages.clear(); }
+
+    quint64 hits() const { return m_hits; }
+    quint64 misses() const { return m_misses; }
+    quint64 abandoned() const { return m_abandoned; }
+
+    static QString normalize(const QString &text);
+
+public slots:
+    /**
+     * Connected to Bot::inlineQuery in the constructor.
+     */
+    void handle(uint64_t updateId, InlineQuery query);
+
+private slots:
+    void flushPending();
+
+private:
+    struct Cached {
+        Cached(const QByteArray &r, const QString &n, qint64 t) : results(r), nextOffset(n), built(t) {}
+        QByteArray results; // compact json
+        QString nextOffset;
+        qint64 built; // msec of m_clock
+    };
+    struct Pending {
+        InlineQuery query;
+        qint64 due; // msec of m_clock
+    };
+
+    QString key(const QString &text, const InlineQuery &query) const;
+    void answer(const QString &cacheKey, const QString &text, const InlineQuery &query);
+    void dropPending(qint32 userId);
+    void scheduleFlush();
+
+    Bot *m_bot;
+    Builder m_builder;
+    qint64 m_ttl; // msec
+    quint32 m_debounce;
+    qint32 m_cacheTime;
+    bool m_personal;
+    QElapsedTimer m_clock;
+    QCache<QString, Cached> m_pages;
+    QHash<qint32, Pending> m_pending; // by user id, newest query only
+    QTimer *m_flushTimer;
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_abandoned;
+};
+
+}
+
+#endif // INLINEQUERYCACHE_H
@@ -0,0 +1,132 @@
+#include <QHash>
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+#include "interner.h"
+
+using namespace Telegram;
+
+static bool same(const User &a, const User &b)
+{
+    return a.id == b.id && a.firstname == b.firstname && a.lastname == b.lastname && a.username == b.username;
+}
+
+static bool same(const Chat &a, const Chat &b)
+{
+    return a.id == b.id && a.type == b.type && a.title == b.title && a.username == b.username
+            && a.firstname == b.firstname && a.lastname == b.lastname;
+}
+
+namespace {
+
+/*
+ * Known instances by id. Lookups only take the read lock, so parsing threads do not serialize on
+ * hits; the write lock is taken on a miss. Values are stored in the hash node itself, a miss
+ * costs that node (nothing for a changed name of a known id), no separate heap copy.
+ */
+template <typename Key, typename T>
+class Table
+{
+public:
+    Table() : m_capacity(10000) {}
+
+    T intern(Key key, const T &value, QAtomicInteger<quint64> &hits)
+    {
+        {
+            QReadLocker lock(&m_lock);
+            typename QHash<Key, T>::const_iterator i = m_entries.constFind(key);
+            if (i != m_entries.constEnd() && same(*i, value)) {
+                hits.fetchAndAddRelaxed(1);
+                return *i;
+            }
+        }
+        QWriteLocker lock(&m_lock);
+        typename QHash<Key, T>::iterator i = m_entries.find(key);
+        if (i != m_entries.end()) {
+            *i = value;
+        } else {
+            // bounded, not LRU: an arbitrary entry makes room, it is interned again on its next message
+            if (m_entries.size() >= m_capacity)
+                m_entries.erase(m_entries.begin());
+            m_entries.insert(key, value);
+        }
+        return value;
+    }
+
+    void reset(int capacity, bool keep)
+    {
+        QWriteLocker lock(&m_lock);
+        m_capacity = qMax(1, capacity);
+        if (!keep)
+            m_entries.clear();
+        while (m_entries.size() > m_capacity)
+            m_entries.erase(m_entries.begin());
+    }
+
+    void clear()
+    {
+        QWriteLocker lock(&m_lock);
+        m_entries.clear();
+    }
+
+private:
+    QReadWriteLock m_lock;
+    QHash<Key, T> m_entries;
+    int m_capacity;
+};
+
+struct Tables
+{
+    Tables() : hits(0) {}
+
+    Table<qint32, User> users;
+    Table<qint64, Chat> chats;
+    QAtomicInteger<quint64> hits;
+};
+
+}
+
+Q_GLOBAL_STATIC(Tables, s_tables)
+static QAtomicInt s_enabled(0);
+
+void Interner::setEnabled(bool enabled, int capacity)
+{
+    Tables *t = s_tables();
+    t->users.reset(capacity, enabled);
+    t->chats.reset(capacity, enabled);
+    s_enabled.store(enabled ? 1 : 0);
+}
+
+bool Interner::isEnabled()
+{
+    return s_enabled.load();
+}
+
+void Interner::clear()
+{
+    Tables *t = s_tables();
+    t->users.clear();
+    t->chats.clear();
+}
+
+quint64 Interner::hits()
+{
+    return s_tables()->hits.load();
+}
+
+User Interner::user(const User &user)
+{
+    if (!s_enabled.load() || !user.id)
+        return user;
+
+    Tables *t = s_tables();
+    return t->users.intern(user.id, user, t->hits);
+}
+
+Chat Interner::chat(const Chat &chat)
+{
+    if (!s_enabled.load() || !chat.id)
+        return chat;
+
+    Tables *t = s_tables();
+    return t->chats.intern(chat.id, chat, t->hits);
+}
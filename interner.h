@@ -0,0 +1,40 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include "types/chat.h"
+#include "types/user.h"
+
+namespace Telegram {
+
+/**
+ * Flyweight tables for the users and chats contained in parsed messages.
+ * The same participants show up in every message of a busy group, and again in forwardFrom and
+ * replied to messages. With interning enabled, a parsed User or Chat whose content equals the
+ * instance already known for its id is replaced by that instance, so its strings are shared
+ * (implicit sharing, a reference count each) instead of kept once per message. A changed name
+ * replaces the known instance. Tables are bounded and shared by all bots of the process, a hit
+ * only takes a read lock of its table. Off by default, enable it after measuring the workload with
+ * examples/parsebench.
+ */
+class Interner
+{
+public:
+    /**
+     * @param capacity - users and chats kept each
+     */
+    static void setEnabled(bool enabled, int capacity = 10000);
+    static bool isEnabled();
+    static void clear();
+
+    /**
+     * @return shared instance equal to user, or user itself if interning is disabled
+     */
+    static User user(const User &user);
+    static Chat chat(const Chat &chat);
+
+    static quint64 hits();
+};
+
+}
+
+#endif // INTERNER_H
@@ -0,0 +1,176 @@
+#include <QThread>
+#include "ioworker.h"
+
+using namespace Telegram;
+
+IoWorker::IoWorker(Networking *net, QObject *receiver) :
+    QObject(0),
+    m_net(net),
+    m_receiver(receiver),
+    m_pollTimer(new QTimer(this)),
+    m_pollReply(0),
+    m_updateInterval(1000),
+    m_pollingTimeout(0),
+    m_updateOffset(0),
+    m_pollBatch(0)
+{
+    m_pollTimer->setSingleShot(true);
+    connect(m_pollTimer, &QTimer::timeout, this, &IoWorker::poll);
+    connect(m_net, &Networking::requestCompleted, this, &IoWorker::requestCompleted);
+    connect(m_net, &Networking::requestFinished, this, &IoWorker::requestFinished);
+}
+
+void IoWorker::post(const IoCommand &command)
+{
+    m_commands.push(command);
+    if (m_commandsSignaled.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "processCommands", Qt::QueuedConnection);
+}
+
+void IoWorker::emitEvent(const IoEvent &event)
+{
+    m_events.push(event);
+    if (m_eventsSignaled.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(m_receiver, "drainIoEvents", Qt::QueuedConnection);
+}
+
+void IoWorker::processCommands()
+{
+    m_commandsSignaled.store(0);
+
+    IoCommand command;
+    while (m_commands.pop(command)) {
+        if (!command.ticket) {
+            if (command.maxInFlight)
+                m_net->setMaxInFlight(command.maxInFlight);
+            if (command.cancelTicket)
+                cancel(command.cancelTicket);
+            continue;
+        }
+
+        // keep the update of the bot thread for tracing
+        Tracer *tracer = m_net->tracer();
+        tracer->setCurrentUpdate(command.updateId);
+        quint64 id = command.useBuilder ?
+                    m_net->enqueue(command.endpoint, command.params, command.method, command.priority, command.deadline) :
+                    m_net->enqueue(command.endpoint, command.encoded, command.method, command.priority, command.deadline);
+        tracer->setCurrentUpdate(0);
+
+        Pending pending;
+        pending.ticket = command.ticket;
+        pending.updateId = command.updateId;
+        m_pending.insert(id, pending);
+    }
+}
+
+void IoWorker::cancel(quint64 ticket)
+{
+    for (auto it = m_pending.constBegin(); it != m_pending.constEnd(); ++it) {
+        if (it.value().ticket == ticket) {
+            m_net->cancel(it.key());
+            return;
+        }
+    }
+}
+
+void IoWorker::requestCompleted(quint64 id, QNetworkReply *reply)
+{
+    auto it = m_pending.find(id);
+    if (it == m_pending.end()) {
+        qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "unknown request" << id;
+        if (reply)
+            reply->deleteLater();
+        return;
+    }
+
+    IoEvent event;
+    event.kind = IoEvent::Reply;
+    event.ticket = it.value().ticket;
+    event.updateId = it.value().updateId;
+    m_pending.erase(it);
+
+    if (reply) {
+        event.body = reply->readAll();
+        event.error = reply->error();
+        event.errorString = reply->errorString();
+        event.httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        reply->deleteLater();
+    } else {
+        event.dropped = true;
+    }
+    emitEvent(event);
+}
+
+void IoWorker::startPolling(quint32 updateInterval, quint32 pollingTimeout)
+{
+    m_updateInterval = updateInterval;
+    m_pollingTimeout = pollingTimeout;
+    poll();
+}
+
+void IoWorker::stop()
+{
+    m_pollTimer->stop();
+    if (m_pollReply)
+        m_pollReply->abort();
+    QThread::currentThread()->quit();
+}
+
+void IoWorker::poll()
+{
+    RequestBuilder params;
+    params.add("offset", m_updateOffset);
+    params.add("limit", 50);
+    params.add("timeout", m_pollingTimeout);
+    m_pollReply = m_net->asyncRequest(ENDPOINT_GET_UPDATES, params, Networking::GET);
+    if (!m_pollReply) {
+        qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "request failed";
+        m_pollTimer->start(m_updateInterval);
+        return;
+    }
+
+    // parse on this thread while the response is still being received
+    m_updateParser.reset();
+    m_pollBatch = 0;
+    QNetworkReply *reply = m_pollReply;
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        m_updateParser.feed(reply, [this](const QJsonObject &obj) { processUpdate(obj); });
+    });
+}
+
+void IoWorker::requestFinished(QNetworkReply *reply)
+{
+    if (reply != m_pollReply) {
+        qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "unexpected reply" << reply;
+        reply->deleteLater();
+        return;
+    }
+    m_pollReply = 0;
+
+    m_updateParser.feed(reply, [this](const QJsonObject &obj) { processUpdate(obj); });
+    if (reply->error() != QNetworkReply::NoError) {
+        qCCritical(CTelNet, "%s", qPrintable(QString("[%1] %2 %3").arg(reply->error()).arg(reply->errorString()).arg(m_updateParser.pendingData().constData())));
+    } else if (!m_updateParser.isOk()) {
+        qCWarning(CTelNet, "Result is not Ok");
+    }
+    m_net->metrics()->recordPollBatch(m_pollBatch);
+
+    if (reply->error() != QNetworkReply::OperationCanceledError)
+        m_pollTimer->start(m_updateInterval);
+    reply->deleteLater();
+}
+
+void IoWorker::processUpdate(const QJsonObject &obj)
+{
+    if (obj.contains("update_id")) {
+        uint64_t id = obj["update_id"].toDouble();
+        if (id >= m_updateOffset)
+            m_updateOffset = id + 1;
+    }
+    ++m_pollBatch;
+
+    IoEvent event;
+    event.kind = IoEvent::Update;
+    event.update = obj;
+    emitEvent(event);
+}
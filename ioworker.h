@@ -0,0 +1,122 @@
+#ifndef IOWORKER_H
+#define IOWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QJsonObject>
+#include <QAtomicInt>
+
+#include "networking.h"
+#include "mpscqueue.h"
+#include "updatestreamparser.h"
+
+namespace Telegram {
+
+/**
+ * Request handed from the bot to the I/O thread.
+ */
+struct IoCommand
+{
+    IoCommand() : ticket(0), method(Networking::GET), priority(Networking::Normal), deadline(0), updateId(0), maxInFlight(0), cancelTicket(0), useBuilder(false) {}
+
+    quint64 ticket; // 0 for configuration commands
+    QString endpoint;
+    RequestBuilder params;
+    QByteArray encoded;
+    Networking::Method method;
+    Networking::Priority priority;
+    qint64 deadline;
+    quint64 updateId;
+    int maxInFlight;
+    quint64 cancelTicket;
+    bool useBuilder;
+};
+
+/**
+ * Finished request or received update handed from the I/O thread to the bot.
+ */
+struct IoEvent
+{
+    enum Kind { Reply, Update };
+
+    IoEvent() : kind(Reply), ticket(0), dropped(false), error(0), httpStatus(0), updateId(0) {}
+
+    Kind kind;
+    quint64 ticket;
+    bool dropped;
+    QByteArray body;
+    int error; // QNetworkReply::NetworkError
+    QString errorString;
+    int httpStatus;
+    quint64 updateId; // update the request was sent for
+    QJsonObject update;
+};
+
+/**
+ * Runs Networking and the getUpdates loop on its own thread.
+ * Commands and events travel through lock-free queues. The side that pushes into an empty queue
+ * wakes the other side with a queued call, nothing ever blocks on the other thread.
+ */
+class IoWorker : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @param net - moved to the thread of the worker together with it
+     * @param receiver - woken by invoking its slot drainIoEvents()
+     */
+    IoWorker(Networking *net, QObject *receiver);
+
+    /**
+     * Bot side: queue a command for the I/O thread.
+     */
+    void post(const IoCommand &command);
+
+    /**
+     * Bot side: take the next event, call after clearing the wake flag with eventsDrained().
+     */
+    bool takeEvent(IoEvent &event) { return m_events.pop(event); }
+    void eventsDrained() { m_eventsSignaled.store(0); }
+
+public slots:
+    void startPolling(quint32 updateInterval, quint32 pollingTimeout);
+    void stop();
+
+private slots:
+    void processCommands();
+    void requestCompleted(quint64 id, QNetworkReply *reply);
+    void requestFinished(QNetworkReply *reply);
+    void poll();
+
+private:
+    void emitEvent(const IoEvent &event);
+    void cancel(quint64 ticket);
+    void processUpdate(const QJsonObject &obj);
+
+    Networking *m_net;
+    QObject *m_receiver;
+
+    MpscQueue<IoCommand> m_commands;
+    QAtomicInt m_commandsSignaled;
+    MpscQueue<IoEvent> m_events;
+    QAtomicInt m_eventsSignaled;
+
+    struct Pending {
+        quint64 ticket;
+        quint64 updateId;
+    };
+    QHash<quint64, Pending> m_pending; // by Networking request id
+
+    QTimer *m_pollTimer;
+    QNetworkReply *m_pollReply;
+    UpdateStreamParser m_updateParser;
+    quint32 m_updateInterval;
+    quint32 m_pollingTimeout;
+    uint64_t m_updateOffset;
+    int m_pollBatch;
+};
+
+}
+
+#endif // IOWORKER_H
@@ -0,0 +1,463 @@
+#include <cstring>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QUrl>
+#include "localtransport.h"
+
+using namespace Telegram;
+
+LocalReply::LocalReply(LocalTransport *transport, const QUrl &url, QNetworkAccessManager::Operation operation) :
+    QNetworkReply(transport),
+    m_transport(transport),
+    m_pos(0),
+    m_received(0)
+{
+    setUrl(url);
+    setOperation(operation);
+    setOpenMode(QIODevice::ReadOnly);
+}
+
+void LocalReply::abort()
+{
+    if (m_transport && !isFinished())
+        m_transport->abort(this);
+}
+
+qint64 LocalReply::bytesAvailable() const
+{
+    return m_buffer.size() - m_pos + QNetworkReply::bytesAvailable();
+}
+
+qint64 LocalReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 n = qMin(maxSize, qint64(m_buffer.size() - m_pos));
+    if (n <= 0)
+        return isFinished() ? -1 : 0;
+    memcpy(data, m_buffer.constData() + m_pos, size_t(n));
+    m_pos += int(n);
+    if (m_pos == m_buffer.size()) {
+        m_buffer.clear();
+        m_pos = 0;
+    }
+    return n;
+}
+
+void LocalReply::setStatus(int status)
+{
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
+    if (status < 400)
+        return;
+
+    // same mapping as QNetworkAccessManager
+    NetworkError error;
+    switch (status) {
+    case 400: error = ProtocolInvalidOperationError; break;
+    case 401: error = AuthenticationRequiredError; break;
+    case 403: error = ContentAccessDenied; break;
+    case 404: error = ContentNotFoundError; break;
+    case 409: error = ContentConflictError; break;
+    case 500: error = InternalServerError; break;
+    default: error = status < 500 ? UnknownContentError : UnknownServerError; break;
+    }
+    setError(error, QString("Server replied with status %1").arg(status));
+}
+
+void LocalReply::appendBody(const char *data, int size)
+{
+    if (size <= 0)
+        return;
+    m_buffer.append(data, size);
+    m_received += size;
+    const QVariant length = header(QNetworkRequest::ContentLengthHeader);
+    emit downloadProgress(m_received, length.isValid() ? length.toLongLong() : -1);
+    emit readyRead();
+}
+
+void LocalReply::fail(QNetworkReply::NetworkError error, const QString &errorString)
+{
+    setError(error, errorString);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    emit errorOccurred(error);
+#else
+    emit QNetworkReply::error(error);
+#endif
+    complete();
+}
+
+void LocalReply::complete()
+{
+    setFinished(true);
+    emit finished();
+    if (m_transport)
+        emit m_transport->finished(this);
+}
+
+LocalTransport::LocalTransport(const QString &address, QObject *parent) :
+    QObject(parent),
+    m_port(0),
+    m_maxConnections(6),
+    m_parsing(0),
+    m_connectQueued(false)
+{
+    const int colon = address.lastIndexOf(QLatin1Char(':'));
+    if (address.startsWith(QLatin1Char('/')) || colon < 0) {
+        m_socketPath = address;
+        m_hostHeader = "localhost";
+    } else {
+        m_host = address.left(colon);
+        m_port = quint16(address.mid(colon + 1).toUInt());
+        m_hostHeader = address.toLatin1();
+    }
+}
+
+LocalTransport::~LocalTransport()
+{
+    foreach (Connection *c, m_connections) {
+        c->socket->disconnect(this);
+        delete c->socket;
+        delete c;
+    }
+}
+
+QNetworkReply *LocalTransport::get(const QByteArray &target)
+{
+    return submit("GET", target, QByteArray(), QByteArray());
+}
+
+QNetworkReply *LocalTransport::post(const QByteArray &target, const QByteArray &contentType, const QByteArray &body)
+{
+    return submit("POST", target, contentType, body);
+}
+
+QNetworkReply *LocalTransport::submit(const QByteArray &method, const QByteArray &target, const QByteArray &contentType, const QByteArray &body)
+{
+    Pending pending;
+    pending.reply = new LocalReply(this, QUrl(QString("http://%1%2").arg(QString::fromLatin1(m_hostHeader), QString::fromLatin1(target))),
+                                   method == "GET" ? QNetworkAccessManager::GetOperation : QNetworkAccessManager::PostOperation);
+    pending.retried = false;
+
+    // whole request in one buffer and one write
+    QByteArray &r = pending.request;
+    r.reserve(method.size() + target.size() + m_hostHeader.size() + contentType.size() + body.size() + 96);
+    r += method;
+    r += ' ';
+    r += target;
+    r += " HTTP/1.1\r\nHost: ";
+    r += m_hostHeader;
+    r += "\r\n";
+    if (method == "POST") {
+        r += "Content-Type: ";
+        r += contentType;
+        r += "\r\nContent-Length: ";
+        r += QByteArray::number(body.size());
+        r += "\r\n";
+    }
+    r += "\r\n";
+    r += body;
+
+    m_pending.enqueue(pending);
+    dispatch();
+    return pending.reply;
+}
+
+void LocalTransport::dispatch()
+{
+    while (!m_pending.isEmpty()) {
+        Connection *idle = 0;
+        foreach (Connection *c, m_connections) {
+            if (!c->reply && c->connected) {
+                idle = c;
+                break;
+            }
+        }
+        if (idle) {
+            start(idle, m_pending.dequeue());
+            continue;
+        }
+        if (m_connections.size() >= m_maxConnections)
+            return;
+        Connection *c = openConnection();
+        start(c, m_pending.dequeue());
+        // connecting can fail right away and fail the reply, callers must get it back first
+        if (!m_connectQueued) {
+            m_connectQueued = true;
+            QMetaObject::invokeMethod(this, "connectSockets", Qt::QueuedConnection);
+        }
+    }
+}
+
+void LocalTransport::connectSockets()
+{
+    m_connectQueued = false;
+    // a failed connect closes its connection and dispatches again
+    const QVector<Connection *> connections = m_connections;
+    foreach (Connection *c, connections) {
+        if (m_connections.contains(c) && !c->connecting) {
+            c->connecting = true;
+            connectSocket(c);
+        }
+    }
+}
+
+LocalTransport::Connection *LocalTransport::openConnection()
+{
+    Connection *c = new Connection;
+    if (m_socketPath.isEmpty()) {
+        c->socket = new QTcpSocket(this);
+        connect(c->socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketClosed()));
+    } else {
+        c->socket = new QLocalSocket(this);
+        connect(c->socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(socketClosed()));
+    }
+    connect(c->socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+    connect(c->socket, SIGNAL(disconnected()), this, SLOT(socketClosed()));
+    connect(c->socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+    m_connections.append(c);
+    m_bySocket.insert(c->socket, c);
+    return c;
+}
+
+void LocalTransport::connectSocket(Connection *c)
+{
+    if (QTcpSocket *socket = qobject_cast<QTcpSocket *>(c->socket))
+        socket->connectToHost(m_host, m_port);
+    else
+        static_cast<QLocalSocket *>(c->socket)->connectToServer(m_socketPath);
+}
+
+void LocalTransport::start(Connection *c, const Pending &pending)
+{
+    c->reply = pending.reply;
+    c->request = pending.request;
+    c->retried = pending.retried;
+    c->state = Connection::StatusLine;
+    c->remaining = 0;
+    c->keepAlive = true;
+    c->chunked = false;
+    if (c->connected)
+        c->socket->write(c->request);
+}
+
+void LocalTransport::socketConnected()
+{
+    Connection *c = m_bySocket.value(sender());
+    if (!c)
+        return;
+    c->connected = true;
+    // requests are written in one piece, don't wait for acks
+    if (QTcpSocket *socket = qobject_cast<QTcpSocket *>(c->socket))
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    if (c->reply)
+        c->socket->write(c->request);
+    else
+        dispatch();
+}
+
+void LocalTransport::socketReadyRead()
+{
+    Connection *c = m_bySocket.value(sender());
+    if (!c)
+        return;
+    c->in += c->socket->readAll();
+    if (!c->reply) {
+        // nothing asked for, the server is misbehaving
+        closeConnection(c);
+        return;
+    }
+    parse(c);
+}
+
+void LocalTransport::parse(Connection *c)
+{
+    // readyRead handlers may abort the reply, which then only detaches it from c
+    m_parsing = c;
+    QString error;
+    bool done = false;
+    int pos = 0;
+    while (c->reply && !done && error.isEmpty() && pos < c->in.size()) {
+        if (c->state == Connection::Body || c->state == Connection::ChunkData || c->state == Connection::UntilClose) {
+            int n = c->in.size() - pos;
+            if (c->state != Connection::UntilClose)
+                n = int(qMin<qint64>(n, c->remaining));
+            c->remaining -= n;
+            const int start = pos;
+            pos += n;
+            if (c->remaining == 0 && c->state == Connection::Body)
+                done = true;
+            else if (c->remaining == 0 && c->state == Connection::ChunkData)
+                c->state = Connection::ChunkEnd;
+            c->reply->appendBody(c->in.constData() + start, n);
+            continue;
+        }
+
+        const int eol = c->in.indexOf("\r\n", pos);
+        if (eol < 0)
+            break;
+        const QByteArray line = QByteArray::fromRawData(c->in.constData() + pos, eol - pos);
+        pos = eol + 2;
+
+        if (c->state == Connection::StatusLine) {
+            // HTTP/1.1 200 OK
+            const int space = line.indexOf(' ');
+            const int status = space > 0 ? line.mid(space + 1, 3).toInt() : 0;
+            if (!status) {
+                error = "Invalid HTTP status line";
+                break;
+            }
+            c->reply->setStatus(status);
+            c->keepAlive = !line.startsWith("HTTP/1.0");
+            c->state = Connection::Headers;
+        } else if (c->state == Connection::Headers) {
+            done = parseHeader(c, line);
+        } else if (c->state == Connection::ChunkSize) {
+            bool ok = false;
+            const int ext = line.indexOf(';');
+            c->remaining = (ext < 0 ? line : line.left(ext)).trimmed().toLongLong(&ok, 16);
+            if (!ok) {
+                error = "Invalid chunk size";
+                break;
+            }
+            c->state = c->remaining ? Connection::ChunkData : Connection::Trailer;
+        } else if (c->state == Connection::ChunkEnd) {
+            c->state = Connection::ChunkSize;
+        } else if (c->state == Connection::Trailer) {
+            done = line.isEmpty();
+        }
+    }
+    m_parsing = 0;
+    c->in.remove(0, pos);
+
+    if (!c->reply) {
+        closeConnection(c);
+        dispatch();
+    } else if (!error.isEmpty()) {
+        LocalReply *reply = c->reply;
+        c->reply = 0;
+        closeConnection(c);
+        reply->fail(QNetworkReply::ProtocolFailure, error);
+        dispatch();
+    } else if (done) {
+        finishResponse(c);
+    }
+}
+
+bool LocalTransport::parseHeader(Connection *c, const QByteArray &line)
+{
+    if (!line.isEmpty()) {
+        const int colon = line.indexOf(':');
+        if (colon <= 0)
+            return false;
+        const QByteArray name = line.left(colon).trimmed();
+        const QByteArray value = line.mid(colon + 1).trimmed();
+        const QByteArray lower = name.toLower();
+        if (lower == "content-length") {
+            c->remaining = value.toLongLong();
+            c->reply->setHeader(QNetworkRequest::ContentLengthHeader, c->remaining);
+        } else if (lower == "transfer-encoding") {
+            c->chunked = value.toLower().contains("chunked");
+        } else if (lower == "connection") {
+            c->keepAlive = value.toLower() != "close";
+        }
+        c->reply->setRawHeader(name, value);
+        return false;
+    }
+
+    // end of headers
+    if (c->chunked) {
+        c->state = Connection::ChunkSize;
+    } else if (c->reply->header(QNetworkRequest::ContentLengthHeader).isValid()) {
+        c->state = Connection::Body;
+        return c->remaining == 0;
+    } else {
+        c->state = Connection::UntilClose;
+        c->keepAlive = false;
+    }
+    return false;
+}
+
+void LocalTransport::finishResponse(Connection *c)
+{
+    LocalReply *reply = c->reply;
+    c->reply = 0;
+    c->request.clear();
+    c->state = Connection::Idle;
+    c->reused = true;
+    if (!c->keepAlive)
+        closeConnection(c);
+    reply->complete();
+    dispatch();
+}
+
+void LocalTransport::socketClosed()
+{
+    QObject *socket = sender();
+    Connection *c = m_bySocket.value(socket);
+    if (!c)
+        return;
+    if (c->reply && c->socket->bytesAvailable()) {
+        c->in += c->socket->readAll();
+        parse(c);
+        c = m_bySocket.value(socket);
+        if (!c)
+            return;
+    }
+
+    LocalReply *reply = c->reply;
+    // a POST may have been processed even though no response arrived, only GET is sent again
+    const bool staleConnection = reply && c->reused && c->state == Connection::StatusLine && c->in.isEmpty() && !c->retried
+            && c->request.startsWith("GET ");
+    const bool untilClose = reply && c->state == Connection::UntilClose;
+    const bool connected = c->connected;
+    const QString errorString = c->socket->errorString();
+    const QByteArray request = c->request;
+    c->reply = 0;
+    closeConnection(c);
+
+    if (staleConnection) {
+        // the server closed the idle connection before it saw the request, send it again once
+        Pending pending;
+        pending.reply = reply;
+        pending.request = request;
+        pending.retried = true;
+        m_pending.prepend(pending);
+    } else if (untilClose) {
+        reply->complete();
+    } else if (reply) {
+        reply->fail(connected ? QNetworkReply::RemoteHostClosedError : QNetworkReply::ConnectionRefusedError, errorString);
+    }
+    dispatch();
+}
+
+void LocalTransport::closeConnection(Connection *c)
+{
+    m_connections.removeOne(c);
+    m_bySocket.remove(c->socket);
+    c->socket->disconnect(this);
+    c->socket->close();
+    c->socket->deleteLater();
+    delete c;
+}
+
+void LocalTransport::abort(LocalReply *reply)
+{
+    for (int i = 0; i < m_pending.size(); ++i) {
+        if (m_pending.at(i).reply == reply) {
+            m_pending.removeAt(i);
+            reply->fail(QNetworkReply::OperationCanceledError, "Operation canceled");
+            return;
+        }
+    }
+    foreach (Connection *c, m_connections) {
+        if (c->reply == reply) {
+            // the rest of the response can't be told apart from the next one, drop the connection
+            c->reply = 0;
+            const bool parsing = c == m_parsing;
+            if (!parsing)
+                closeConnection(c);
+            reply->fail(QNetworkReply::OperationCanceledError, "Operation canceled");
+            if (!parsing)
+                dispatch();
+            return;
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef LOCALTRANSPORT_H
+#define LOCALTRANSPORT_H
+
+#include <QObject>
+#include <QNetworkReply>
+#include <QNetworkAccessManager>
+#include <QByteArray>
+#include <QQueue>
+#include <QVector>
+#include <QHash>
+
+namespace Telegram {
+
+class LocalTransport;
+
+/**
+ * Reply of a LocalTransport request. Body data can be read while it is still being received.
+ */
+class LocalReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    LocalReply(LocalTransport *transport, const QUrl &url, QNetworkAccessManager::Operation operation);
+
+    void abort();
+    bool isSequential() const { return true; }
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+private:
+    friend class LocalTransport;
+    void setStatus(int status);
+    void appendBody(const char *data, int size);
+    void fail(QNetworkReply::NetworkError error, const QString &errorString);
+    void complete();
+
+    LocalTransport *m_transport;
+    QByteArray m_buffer;
+    int m_pos;
+    qint64 m_received; // for downloadProgress
+};
+
+/**
+ * Minimal HTTP/1.1 client for a Bot API server on the same host, reached through a Unix domain
+ * socket or plain loopback TCP. Connections are kept alive and reused, one request at a time
+ * each, up to maxConnections; further requests wait. There is no TLS, proxy or cookie handling,
+ * only what the bot api needs: GET and POST, Content-Length and chunked responses.
+ * Replies never finish before get() or post() returned, connection errors included.
+ * A GET the server closed a reused connection on without answering is sent once more on a new
+ * connection; a POST fails with RemoteHostClosedError instead, it may have been processed.
+ */
+class LocalTransport : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @param address - path of a Unix domain socket or host:port for TCP
+     */
+    explicit LocalTransport(const QString &address, QObject *parent = 0);
+    ~LocalTransport();
+
+    /**
+     * @param max - connections used at the same time, default 6 like QNetworkAccessManager
+     */
+    void setMaxConnections(int max) { m_maxConnections = qMax(1, max); }
+
+    /**
+     * @param target - path and query, e.g. /bot<token>/getMe
+     */
+    QNetworkReply *get(const QByteArray &target);
+    QNetworkReply *post(const QByteArray &target, const QByteArray &contentType, const QByteArray &body);
+
+signals:
+    void finished(QNetworkReply *reply);
+
+private slots:
+    void socketConnected();
+    void socketReadyRead();
+    void socketClosed();
+    void connectSockets();
+
+private:
+    friend class LocalReply;
+
+    struct Connection {
+        enum State { Idle, StatusLine, Headers, Body, ChunkSize, ChunkData, ChunkEnd, Trailer, UntilClose };
+
+        Connection() : socket(0), connecting(false), connected(false), reused(false), retried(false), reply(0), state(Idle), remaining(0), keepAlive(true), chunked(false) {}
+        QIODevice *socket;
+        bool connecting; // connectSocket was called
+        bool connected;
+        bool reused; // served a request before, may have been closed by the server meanwhile
+        bool retried; // request was already sent again after a stale connection
+        LocalReply *reply;
+        QByteArray request; // kept to retry on a stale connection
+        QByteArray in;
+        State state;
+        qint64 remaining; // of body or chunk
+        bool keepAlive;
+        bool chunked;
+    };
+    struct Pending {
+        LocalReply *reply;
+        QByteArray request;
+        bool retried;
+    };
+
+    QNetworkReply *submit(const QByteArray &method, const QByteArray &target, const QByteArray &contentType, const QByteArray &body);
+    void dispatch();
+    void start(Connection *c, const Pending &pending);
+    Connection *openConnection();
+    void connectSocket(Connection *c);
+    void parse(Connection *c);
+    bool parseHeader(Connection *c, const QByteArray &line); // true if the response is complete
+    void finishResponse(Connection *c);
+    void closeConnection(Connection *c);
+    void abort(LocalReply *reply);
+
+    QString m_socketPath; // empty for TCP
+    QString m_host;
+    quint16 m_port;
+    QByteArray m_hostHeader;
+    int m_maxConnections;
+    QVector<Connection *> m_connections;
+    Connection *m_parsing;
+    QHash<QObject *, Connection *> m_bySocket;
+    QQueue<Pending> m_pending;
+    bool m_connectQueued; // connectSockets is queued
+};
+
+}
+
+#endif // LOCALTRANSPORT_H
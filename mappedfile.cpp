@@ -0,0 +1,44 @@
+#include <climits>
+#include "mappedfile.h"
+
+using namespace Telegram;
+
+MappedFile::MappedFile(const QString &fileName) :
+    m_file(fileName),
+    m_data(0),
+    m_size(0),
+    m_valid(false)
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+        return;
+    m_size = m_file.size();
+    // empty files can not be mapped
+    if (m_size > 0)
+        m_data = m_file.map(0, m_size);
+    m_valid = m_size == 0 || m_data;
+    // the mapping stays valid after closing
+    m_file.close();
+}
+
+MappedFile::MappedFile(const QByteArray &content) :
+    m_content(content),
+    m_data(0),
+    m_size(content.size()),
+    m_valid(true)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+}
+
+QByteArray MappedFile::data() const
+{
+    if (!m_data)
+        return m_content;
+    if (m_size > INT_MAX)
+        return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(m_data), int(m_size));
+}
@@ -0,0 +1,44 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+#include <QByteArray>
+
+namespace Telegram {
+
+/**
+ * Read only memory mapping of a whole file, unmapped on destruction.
+ * Pages are only read from disk when touched, so large media costs no copy and no upfront read.
+ * Can also own content that was received instead, so mapped and downloaded files are handed out
+ * the same way.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const QString &fileName);
+    explicit MappedFile(const QByteArray &content);
+    ~MappedFile();
+
+    bool isValid() const { return m_valid; }
+    qint64 size() const { return m_size; }
+    QString errorString() const { return m_file.errorString(); }
+
+    /**
+     * Content without a copy, only valid as long as this object lives.
+     * Empty for files QByteArray can not hold (2 GiB and more).
+     */
+    QByteArray data() const;
+
+private:
+    Q_DISABLE_COPY(MappedFile)
+
+    QFile m_file;
+    QByteArray m_content; // if not mapped
+    uchar *m_data;
+    qint64 m_size;
+    bool m_valid;
+};
+
+}
+
+#endif // MAPPEDFILE_H
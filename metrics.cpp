@@ -0,0 +1,335 @@
+#include <QTcpServer>
+#include <QDebug>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QHostAddress>
+#include <QtAlgorithms>
+#include "metrics.h"
+#include "networking.h"
+
+using namespace Telegram;
+
+void Histogram::record(quint64 value)
+{
+    m_buckets[bucketIndex(value)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(value);
+}
+
+int Histogram::bucketIndex(quint64 value)
+{
+    if (value < SubBuckets)
+        return int(value);
+    if (value >= (Q_UINT64_C(1) << MaxBits))
+        value = (Q_UINT64_C(1) << MaxBits) - 1;
+
+    const int msb = 63 - int(qCountLeadingZeroBits(value));
+    const int shift = msb - SubBucketBits;
+    return (msb - SubBucketBits + 1) * SubBuckets + int((value >> shift) & (SubBuckets - 1));
+}
+
+quint64 Histogram::bucketUpperBound(int index)
+{
+    if (index < SubBuckets)
+        return quint64(index);
+
+    const int shift = index / SubBuckets - 1;
+    const quint64 lower = quint64(SubBuckets + index % SubBuckets) << shift;
+    return lower + (Q_UINT64_C(1) << shift) - 1;
+}
+
+quint64 Histogram::countAtOrBelow(quint64 value) const
+{
+    quint64 ret = 0;
+    for (int i = 0; i < BucketCount && bucketUpperBound(i) <= value; ++i)
+        ret += m_buckets[i].load();
+    return ret;
+}
+
+quint64 Histogram::valueAtQuantile(double quantile) const
+{
+    const quint64 total = count();
+    if (!total)
+        return 0;
+
+    const quint64 wanted = qMax<quint64>(1, quint64(quantile * double(total) + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].load();
+        if (seen >= wanted)
+            return bucketUpperBound(i);
+    }
+    return bucketUpperBound(BucketCount - 1);
+}
+
+Metrics::Metrics() :
+    m_endpoints(0)
+{
+    m_clock.start();
+}
+
+Metrics::~Metrics()
+{
+    EndpointStats *stats = m_endpoints.load();
+    while (stats) {
+        EndpointStats *next = stats->next;
+        delete stats;
+        stats = next;
+    }
+}
+
+EndpointStats *Metrics::endpoint(const QString &name)
+{
+    EndpointStats *head = m_endpoints.loadAcquire();
+    for (EndpointStats *s = head; s; s = s->next) {
+        if (s->name == name)
+            return s;
+    }
+
+    // insert-only list: prepend with CAS, recheck the entries added meanwhile
+    EndpointStats *stats = new EndpointStats(name);
+    for (;;) {
+        stats->next = head;
+        if (m_endpoints.testAndSetOrdered(head, stats))
+            return stats;
+        EndpointStats *newHead = m_endpoints.loadAcquire();
+        for (EndpointStats *s = newHead; s != head; s = s->next) {
+            if (s->name == name) {
+                delete stats;
+                return s;
+            }
+        }
+        head = newHead;
+    }
+}
+
+EndpointStats *Metrics::requestStarted(const QString &endpoint, qint64 bytesOut)
+{
+    EndpointStats *stats = this->endpoint(endpoint);
+    stats->requests.fetchAndAddRelaxed(1);
+    stats->bytesOut.fetchAndAddRelaxed(quint64(qMax<qint64>(0, bytesOut)));
+    stats->inFlight.fetchAndAddRelaxed(1);
+    m_inFlight.fetchAndAddRelaxed(1);
+    return stats;
+}
+
+void Metrics::requestFinished(EndpointStats *stats, qint64 startNsec, qint64 bytesIn, int httpStatus, bool networkError)
+{
+    const qint64 elapsed = nsecsElapsed() - startNsec;
+    stats->latency.record(quint64(qMax<qint64>(0, elapsed)) / 1000);
+    stats->bytesIn.fetchAndAddRelaxed(quint64(qMax<qint64>(0, bytesIn)));
+    stats->inFlight.fetchAndSubRelaxed(1);
+    m_inFlight.fetchAndSubRelaxed(1);
+
+    if (httpStatus > 0 && httpStatus < MaxStatus)
+        m_status[httpStatus].fetchAndAddRelaxed(1);
+    else if (networkError)
+        m_networkErrors.fetchAndAddRelaxed(1);
+
+    if (networkError || httpStatus >= 400)
+        stats->errors.fetchAndAddRelaxed(1);
+}
+
+void Metrics::recordRetry(const QString &endpoint)
+{
+    this->endpoint(endpoint)->retries.fetchAndAddRelaxed(1);
+}
+
+void Metrics::recordDropped(const QString &endpoint)
+{
+    this->endpoint(endpoint)->dropped.fetchAndAddRelaxed(1);
+}
+
+void Metrics::setQueueDepth(int lane, int depth)
+{
+    if (lane >= 0 && lane < Lanes)
+        m_queueDepth[lane].store(depth);
+}
+
+int Metrics::queueDepth(int lane) const
+{
+    if (lane < 0 || lane >= Lanes)
+        return 0;
+    return m_queueDepth[lane].load();
+}
+
+void Metrics::recordPollBatch(int updates)
+{
+    m_pollBatch.record(quint64(qMax(0, updates)));
+}
+
+void Metrics::recordUpdateLag(qint64 msec)
+{
+    m_updateLag.record(quint64(qMax<qint64>(0, msec)));
+}
+
+quint64 Metrics::responses(int httpStatus) const
+{
+    if (httpStatus <= 0 || httpStatus >= MaxStatus)
+        return 0;
+    return m_status[httpStatus].load();
+}
+
+static void appendHeader(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+static void appendSample(QByteArray &out, const char *name, const QByteArray &labels, const QByteArray &value)
+{
+    out += name;
+    if (!labels.isEmpty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+// bounds are in units of the histogram, scale converts them and the sum to the exported unit
+static void appendHistogram(QByteArray &out, const char *name, const QByteArray &labels, const Histogram &h,
+                            const quint64 *bounds, int boundCount, double scale)
+{
+    const QByteArray bucket = QByteArray(name) + "_bucket";
+    const QByteArray prefix = labels.isEmpty() ? QByteArray() : labels + ',';
+    for (int i = 0; i < boundCount; ++i) {
+        appendSample(out, bucket.constData(), prefix + "le=\"" + QByteArray::number(double(bounds[i]) * scale) + '"',
+                     QByteArray::number(h.countAtOrBelow(bounds[i])));
+    }
+    appendSample(out, bucket.constData(), prefix + "le=\"+Inf\"", QByteArray::number(h.count()));
+    appendSample(out, (QByteArray(name) + "_sum").constData(), labels, QByteArray::number(double(h.sum()) * scale));
+    appendSample(out, (QByteArray(name) + "_count").constData(), labels, QByteArray::number(h.count()));
+}
+
+QByteArray Metrics::prometheus() const
+{
+    static const quint64 latencyBounds[] = { 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+                                             1000000, 2500000, 5000000, 10000000, 30000000, 60000000 };
+    static const quint64 batchBounds[] = { 0, 1, 2, 5, 10, 20, 50, 100 };
+    static const quint64 lagBounds[] = { 100, 500, 1000, 2000, 5000, 10000, 30000, 60000, 300000 };
+
+    QByteArray out;
+    out.reserve(8192);
+
+    struct Counter { const char *name; const char *help; QAtomicInteger<quint64> EndpointStats::*member; };
+    static const Counter counters[] = {
+        { "telegram_requests_total", "Requests sent per endpoint.", &EndpointStats::requests },
+        { "telegram_request_errors_total", "Requests failed with a network error or HTTP status >= 400.", &EndpointStats::errors },
+        { "telegram_request_retries_total", "Requests retried after flood control.", &EndpointStats::retries },
+        { "telegram_requests_dropped_total", "Queued requests dropped at their deadline.", &EndpointStats::dropped },
+        { "telegram_request_bytes_total", "Request body and query bytes sent.", &EndpointStats::bytesOut },
+        { "telegram_response_bytes_total", "Response bytes received.", &EndpointStats::bytesIn }
+    };
+
+    EndpointStats *head = m_endpoints.loadAcquire();
+    for (const Counter &c : counters) {
+        appendHeader(out, c.name, "counter", c.help);
+        for (EndpointStats *s = head; s; s = s->next)
+            appendSample(out, c.name, "endpoint=\"" + s->name.mid(1).toUtf8() + '"', QByteArray::number((s->*c.member).load()));
+    }
+
+    appendHeader(out, "telegram_requests_in_flight", "gauge", "Requests waiting for a reply.");
+    for (EndpointStats *s = head; s; s = s->next)
+        appendSample(out, "telegram_requests_in_flight", "endpoint=\"" + s->name.mid(1).toUtf8() + '"', QByteArray::number(s->inFlight.load()));
+
+    static const char *const lanes[Lanes] = { "interactive", "normal", "bulk" };
+    appendHeader(out, "telegram_queued_requests", "gauge", "Requests waiting in the send queue by lane.");
+    for (int i = 0; i < Lanes; ++i)
+        appendSample(out, "telegram_queued_requests", QByteArray("lane=\"") + lanes[i] + '"', QByteArray::number(m_queueDepth[i].load()));
+
+    appendHeader(out, "telegram_request_duration_seconds", "histogram", "Time from sending a request until its reply finished.");
+    for (EndpointStats *s = head; s; s = s->next)
+        appendHistogram(out, "telegram_request_duration_seconds", "endpoint=\"" + s->name.mid(1).toUtf8() + '"', s->latency,
+                        latencyBounds, int(sizeof(latencyBounds) / sizeof(*latencyBounds)), 1e-6);
+
+    appendHeader(out, "telegram_responses_total", "counter", "Replies by HTTP status, equal to the error_code of failed calls.");
+    for (int i = 1; i < MaxStatus; ++i) {
+        const quint64 n = m_status[i].load();
+        if (n)
+            appendSample(out, "telegram_responses_total", "code=\"" + QByteArray::number(i) + '"', QByteArray::number(n));
+    }
+
+    appendHeader(out, "telegram_network_errors_total", "counter", "Requests failed without HTTP status.");
+    appendSample(out, "telegram_network_errors_total", QByteArray(), QByteArray::number(m_networkErrors.load()));
+
+    appendHeader(out, "telegram_poll_batch_size", "histogram", "Updates received per getUpdates call.");
+    appendHistogram(out, "telegram_poll_batch_size", QByteArray(), m_pollBatch,
+                    batchBounds, int(sizeof(batchBounds) / sizeof(*batchBounds)), 1);
+
+    appendHeader(out, "telegram_update_lag_seconds", "histogram", "Time between message date and its processing.");
+    appendHistogram(out, "telegram_update_lag_seconds", QByteArray(), m_updateLag,
+                    lagBounds, int(sizeof(lagBounds) / sizeof(*lagBounds)), 1e-3);
+
+    return out;
+}
+
+MetricsServer::MetricsServer(const Metrics *metrics, QObject *parent) :
+    QObject(parent),
+    m_metrics(metrics),
+    m_server(new QTcpServer(this))
+{
+    connect(m_server, &QTcpServer::newConnection, this, &MetricsServer::newConnection);
+}
+
+bool MetricsServer::listen(quint16 port, bool localOnly)
+{
+    if (!m_server->listen(localOnly ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(QHostAddress::Any), port)) {
+        qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "could not listen on port" << port << m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+quint16 MetricsServer::serverPort() const
+{
+    return m_server->serverPort();
+}
+
+void MetricsServer::newConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        // clients that never finish their request line, or never read the answer, don't keep the socket
+        QTimer::singleShot(MetricsServer::ReadTimeout, socket, [socket]() {
+            socket->abort();
+            socket->deleteLater();
+        });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            if (!socket->canReadLine()) {
+                if (socket->bytesAvailable() > MaxRequestLine) {
+                    socket->abort();
+                    socket->deleteLater();
+                }
+                return;
+            }
+            // answered once, the rest of the request is ignored
+            disconnect(socket, &QTcpSocket::readyRead, this, 0);
+            // only the request line matters, e.g. "GET /metrics HTTP/1.1"
+            const QList<QByteArray> request = socket->readLine().split(' ');
+            QByteArray body;
+            QByteArray status;
+            if (request.size() >= 2 && request[0] == "GET" && (request[1] == "/metrics" || request[1] == "/")) {
+                status = "200 OK";
+                body = m_metrics->prometheus();
+            } else {
+                status = "404 Not Found";
+            }
+            socket->write("HTTP/1.0 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n");
+            socket->write(body);
+            socket->disconnectFromHost();
+        });
+    }
+}
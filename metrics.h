@@ -0,0 +1,157 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+
+class QTcpServer;
+
+namespace Telegram {
+
+/**
+ * Log-linear histogram of non-negative integer values (HDR style).
+ * Values are counted in buckets with 3 bits of sub-bucket precision, i.e. within 12.5% of the
+ * recorded value, up to 2^40. Recording is a single atomic increment, readers may run concurrently.
+ */
+class Histogram
+{
+public:
+    enum { SubBucketBits = 3, SubBuckets = 1 << SubBucketBits, MaxBits = 40, BucketCount = (MaxBits - SubBucketBits + 1) * SubBuckets };
+
+    void record(quint64 value);
+
+    quint64 count() const { return m_count.load(); }
+    quint64 sum() const { return m_sum.load(); }
+
+    /**
+     * @return number of recorded values whose bucket lies completely at or below value
+     */
+    quint64 countAtOrBelow(quint64 value) const;
+
+    /**
+     * @param quantile - between 0 and 1
+     * @return upper bound of the bucket containing the quantile
+     */
+    quint64 valueAtQuantile(double quantile) const;
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketUpperBound(int index);
+
+private:
+    QAtomicInteger<quint64> m_buckets[BucketCount];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+};
+
+/**
+ * Counters of a single API endpoint.
+ */
+struct EndpointStats
+{
+    explicit EndpointStats(const QString &aName) : name(aName), next(0) {}
+
+    const QString name;
+    QAtomicInteger<quint64> requests;
+    QAtomicInteger<quint64> errors;
+    QAtomicInteger<quint64> retries;
+    QAtomicInteger<quint64> dropped;
+    QAtomicInteger<quint64> bytesOut;
+    QAtomicInteger<quint64> bytesIn;
+    QAtomicInt inFlight;
+    Histogram latency; // usec
+    EndpointStats *next;
+};
+
+/**
+ * Request, error and polling statistics of a bot.
+ * All counters are atomics, endpoints are kept in an insert-only list, so recording never takes a
+ * lock and the metrics can be read from any thread while requests are running.
+ * Responses are counted by HTTP status which equals the error_code of the bot api.
+ */
+class Metrics
+{
+public:
+    Metrics();
+    ~Metrics();
+
+    /**
+     * @return stats of endpoint, created on first use. The pointer is valid as long as Metrics.
+     */
+    EndpointStats *endpoint(const QString &name);
+
+    EndpointStats *requestStarted(const QString &endpoint, qint64 bytesOut);
+    void requestFinished(EndpointStats *stats, qint64 startNsec, qint64 bytesIn, int httpStatus, bool networkError);
+    void recordRetry(const QString &endpoint);
+    void recordDropped(const QString &endpoint);
+    void setQueueDepth(int lane, int depth);
+    void recordPollBatch(int updates);
+    void recordUpdateLag(qint64 msec);
+
+    /**
+     * Monotonic clock used for request durations.
+     */
+    qint64 nsecsElapsed() const { return m_clock.nsecsElapsed(); }
+
+    int inFlight() const { return m_inFlight.load(); }
+    int queueDepth(int lane) const;
+    quint64 responses(int httpStatus) const;
+    quint64 networkErrors() const { return m_networkErrors.load(); }
+    const Histogram &pollBatchSizes() const { return m_pollBatch; }
+    const Histogram &updateLag() const { return m_updateLag; }
+
+    /**
+     * @return all metrics in Prometheus text exposition format
+     */
+    QByteArray prometheus() const;
+
+private:
+    Q_DISABLE_COPY(Metrics)
+
+    enum { MaxStatus = 600, Lanes = 3 };
+
+    QElapsedTimer m_clock;
+    QAtomicPointer<EndpointStats> m_endpoints;
+    QAtomicInt m_inFlight;
+    QAtomicInt m_queueDepth[Lanes]; // by Networking::Priority
+    QAtomicInteger<quint64> m_status[MaxStatus];
+    QAtomicInteger<quint64> m_networkErrors;
+    Histogram m_pollBatch;
+    Histogram m_updateLag; // msec
+};
+
+/**
+ * Serves Metrics::prometheus() as http://address:port/metrics
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(const Metrics *metrics, QObject *parent = 0);
+
+    enum {
+        ReadTimeout = 5000,  // msec after which a connection is closed in any case
+        MaxRequestLine = 8192
+    };
+
+    /**
+     * @param port - 0 picks a free port
+     * @param localOnly - listen on the loopback interface only
+     */
+    bool listen(quint16 port, bool localOnly = true);
+    quint16 serverPort() const;
+
+private slots:
+    void newConnection();
+
+private:
+    const Metrics *m_metrics;
+    QTcpServer *m_server;
+};
+
+}
+
+#endif // METRICS_H
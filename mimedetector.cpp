@@ -0,0 +1,70 @@
+#include <QCache>
+#include <QMutex>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMimeDatabase>
+#include "mimedetector.h"
+
+using namespace Telegram;
+
+namespace {
+
+struct Detected
+{
+    Detected(const QString &t, qint64 s, qint64 m) : type(t), size(s), modified(m) {}
+    QString type;
+    qint64 size;
+    qint64 modified; // msec since epoch
+};
+
+struct DetectorState
+{
+    DetectorState() : files(1000) {}
+
+    QMimeDatabase db;
+    QMutex mutex;
+    QCache<QString, Detected> files;
+};
+
+}
+
+Q_GLOBAL_STATIC(DetectorState, s_state)
+
+QString MimeDetector::mimeTypeForData(const QString &fileName, const QByteArray &data)
+{
+    // no copy, QMimeDatabase only reads
+    const QByteArray head = QByteArray::fromRawData(data.constData(), qMin<int>(data.size(), ProbeSize));
+    return s_state()->db.mimeTypeForFileNameAndData(fileName, head).name();
+}
+
+QString MimeDetector::mimeTypeForFile(const QString &path)
+{
+    const QFileInfo info(path);
+    const qint64 size = info.size();
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+
+    DetectorState *state = s_state();
+    {
+        QMutexLocker lock(&state->mutex);
+        Detected *d = state->files.object(path);
+        if (d && d->size == size && d->modified == modified)
+            return d->type;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QStringLiteral("application/octet-stream");
+    const QString type = state->db.mimeTypeForFileNameAndData(path, file.read(ProbeSize)).name();
+
+    QMutexLocker lock(&state->mutex);
+    state->files.insert(path, new Detected(type, size, modified));
+    return type;
+}
+
+void MimeDetector::setCacheCapacity(int capacity)
+{
+    DetectorState *state = s_state();
+    QMutexLocker lock(&state->mutex);
+    state->files.setMaxCost(capacity);
+}
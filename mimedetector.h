@@ -0,0 +1,40 @@
+#ifndef MIMEDETECTOR_H
+#define MIMEDETECTOR_H
+
+#include <QString>
+#include <QByteArray>
+
+// dynamic property of a QFile passed to Bot::send*, skips detection
+#define MIME_TYPE_PROPERTY "mimeType"
+
+namespace Telegram {
+
+/**
+ * Content type detection for uploads.
+ * Uses the file name and magic bytes of the first ProbeSize bytes only, never the whole payload.
+ * Results for files on disk are cached by path, size and modification time.
+ */
+class MimeDetector
+{
+public:
+    enum { ProbeSize = 4096 };
+
+    /**
+     * @return detected type, application/octet-stream if the file can't be read
+     */
+    static QString mimeTypeForFile(const QString &path);
+
+    /**
+     * @param data - payload, only its start is looked at
+     */
+    static QString mimeTypeForData(const QString &fileName, const QByteArray &data);
+
+    /**
+     * @param capacity - number of files kept in the cache
+     */
+    static void setCacheCapacity(int capacity);
+};
+
+}
+
+#endif // MIMEDETECTOR_H
@@ -0,0 +1,83 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <QAtomicPointer>
+
+namespace Telegram {
+
+/**
+ * Unbounded lock-free queue for many producers and a single consumer (Vyukov).
+ * push() is wait-free and may be called from any thread, pop() only from the consumer thread.
+ * pop() can return false while a concurrent push() is half done; producers therefore signal the
+ * consumer after pushing, see IoWorker.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {}
+        // a node left behind by an unfinished push can't exist once all producers stopped
+    }
+
+    void push(const T &value) {
+        append(new Node(value));
+    }
+
+    bool pop(T &value) {
+        Node *tail = m_tail;
+        Node *next = tail->next.loadAcquire();
+        if (tail == &m_stub) {
+            if (!next)
+                return false;
+            m_tail = next;
+            tail = next;
+            next = next->next.loadAcquire();
+        }
+        if (next) {
+            m_tail = next;
+            value = tail->value;
+            delete tail;
+            return true;
+        }
+        if (tail != m_head.loadAcquire())
+            return false; // producer between exchange and link
+
+        // tail is the last node, put the stub behind it so it can be released
+        append(&m_stub);
+        next = tail->next.loadAcquire();
+        if (next) {
+            m_tail = next;
+            value = tail->value;
+            delete tail;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    Q_DISABLE_COPY(MpscQueue)
+
+    struct Node {
+        Node() : next(0) {}
+        explicit Node(const T &v) : value(v), next(0) {}
+        T value;
+        QAtomicPointer<Node> next;
+    };
+
+    void append(Node *node) {
+        node->next.store(0);
+        Node *prev = m_head.fetchAndStoreOrdered(node);
+        prev->next.storeRelease(node);
+    }
+
+    Node m_stub;
+    QAtomicPointer<Node> m_head; // last pushed, written by producers
+    Node *m_tail; // next to pop, consumer only
+};
+
+}
+
+#endif // MPSCQUEUE_H
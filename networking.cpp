@@ -1,8 +1,11 @@
 #include "networking.h"
 
 #include <QDebug>
+#include <QTimer>
+#include <QVector>
+#include <QHttpMultiPart>
+#include <QSaveFile>
 #include <QLoggingCategory>
-#include <ctime>
 
 using namespace Telegram;
 
@@ -11,21 +14,80 @@ Q_LOGGING_CATEGORY(Telegram::CTelNet, "telegram.net")
 Networking::Networking(const QString &token, QObject *parent) :
     QObject(parent),
     m_nam(new QNetworkAccessManager(this)),
-    m_token(token)
+    m_token(token),
+    m_sslConfig(QSslConfiguration::defaultConfiguration()),
+    m_local(0),
+    m_nextRequestId(0),
+    m_maxInFlight(5),
+    m_scheduledInFlight(0),
+    m_pumpPending(false)
 {
+    m_weights[Interactive] = 0; // strict priority, no weight
+    m_weights[Normal] = 4;
+    m_weights[Bulk] = 1;
+    for (int i = 0; i < PriorityCount; ++i)
+        m_credits[i] = 0;
+
     connect(m_nam, SIGNAL(finished(QNetworkReply*)),
-            this, SIGNAL(requestFinished(QNetworkReply*)));
+            this, SLOT(replyFinished(QNetworkReply*)));
 }
 
 Networking::~Networking()
 {
     disconnect(m_nam, SIGNAL(finished(QNetworkReply*)),
-               this, SIGNAL(requestFinished(QNetworkReply*)));
+               this, SLOT(replyFinished(QNetworkReply*)));
 
     delete m_nam;
 }
 
 QNetworkReply *Networking::asyncRequest(const QString &endpoint, const ParameterList &params, Networking::Method method)
+{
+    return asyncRequest(endpoint, RequestBuilder(params), method);
+}
+
+QNetworkReply *Networking::asyncRequest(const QString &endpoint, const RequestBuilder &params, Networking::Method method)
+{
+    if (method == GET || method == POST || method == DOWNLOAD) {
+        return asyncRequest(endpoint, params.encoded(), method);
+    } else if (method != UPLOAD) {
+        qCCritical(CTelNet, "No valid method!");
+        return 0;
+    }
+
+#ifdef DEBUG
+    qCDebug(CTelNet, "HTTP request: %s %d %d parameters", qUtf8Printable(buildUrl(endpoint).toString()), method, params.count());
+#endif
+
+    if (params.hasStreamedFiles()) {
+        QNetworkReply *reply = sendMultipart(endpoint, params);
+        if (reply)
+            track(reply, endpoint, params.contentSize(), ++m_nextRequestId, m_tracer.currentUpdate(), false);
+        return reply;
+    }
+
+    QByteArray boundary = params.multipartBoundary();
+    QByteArray requestData = params.multipart(boundary);
+    QNetworkReply *reply = sendMultipart(endpoint, boundary, requestData);
+    if (reply)
+        track(reply, endpoint, requestData.size(), ++m_nextRequestId, m_tracer.currentUpdate(), false);
+
+    return reply;
+}
+
+QNetworkReply *Networking::asyncRequest(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method)
+{
+#ifdef DEBUG
+    qCDebug(CTelNet, "HTTP request: %s %d %s", qUtf8Printable(buildUrl(endpoint).toString()), method, encodedParams.constData());
+#endif
+
+    QNetworkReply *reply = send(endpoint, encodedParams, method);
+    if (reply)
+        track(reply, statsName(endpoint, method), encodedParams.size(), ++m_nextRequestId, m_tracer.currentUpdate(), false);
+
+    return reply;
+}
+
+QNetworkReply *Networking::sendMultipart(const QString &endpoint, const QByteArray &boundary, const QByteArray &data)
 {
     if (endpoint.isEmpty()) {
         qCWarning(CTelNet) << "Cannot do request without endpoint";
@@ -36,131 +98,427 @@ QNetworkReply *Networking::asyncRequest(const QString &endpoint, const Parameter
         return 0;
     }
 
-    QNetworkRequest req;
-    QUrl url = buildUrl(endpoint);
-    req.setUrl(url);
+    if (m_local)
+        return m_local->post(target(endpoint), "multipart/form-data; boundary=" + boundary, data);
 
-#ifdef DEBUG
-    qCDebug(CTelNet, "HTTP request: %s %d %s", qUtf8Printable(req.url().toString()), method, parameterListToString(params).toStdString().c_str());
-#endif
+    QNetworkRequest req = prototype(endpoint);
+    req.setHeader(QNetworkRequest::ContentTypeHeader, "multipart/form-data; boundary=" + boundary);
+    req.setHeader(QNetworkRequest::ContentLengthHeader, data.length());
+    QNetworkReply *reply = m_nam->post(req, data);
+
+    if (reply == NULL) {
+        qCWarning(CTelNet, "Reply is NULL");
+    }
+
+    return reply;
+}
+
+QNetworkReply *Networking::sendMultipart(const QString &endpoint, const RequestBuilder &params)
+{
+    if (endpoint.isEmpty()) {
+        qCWarning(CTelNet) << "Cannot do request without endpoint";
+        return 0;
+    }
+    if (m_token.isEmpty()) {
+        qCWarning(CTelNet, "Cannot do request without a Telegram Bot Token");
+        return 0;
+    }
+
+    if (m_local) {
+        const QByteArray boundary = params.multipartBoundary();
+        return m_local->post(target(endpoint), "multipart/form-data; boundary=" + boundary, params.multipart(boundary));
+    }
+
+    QHttpMultiPart *multiPart = params.httpMultiPart();
+    if (!multiPart)
+        return 0;
+
+    QNetworkReply *reply = m_nam->post(prototype(endpoint), multiPart);
+    if (reply == NULL) {
+        qCWarning(CTelNet, "Reply is NULL");
+        delete multiPart;
+        return 0;
+    }
+    // files are read while the body is sent
+    multiPart->setParent(reply);
+
+    return reply;
+}
+
+QNetworkReply *Networking::send(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method)
+{
+    if (endpoint.isEmpty()) {
+        qCWarning(CTelNet) << "Cannot do request without endpoint";
+        return 0;
+    }
+    if (m_token.isEmpty()) {
+        qCWarning(CTelNet, "Cannot do request without a Telegram Bot Token");
+        return 0;
+    }
+
+    if (method == GET && encodedParams.size() > MAX_QUERY_LENGTH) {
+        // the bot api accepts all methods as POST, avoid overlong urls
+        method = POST;
+    }
+
+    if (m_local && method == DOWNLOAD) {
+        return m_local->get(buildTarget(endpoint, DOWNLOAD));
+    } else if (m_local && method == GET) {
+        const QByteArray &path = target(endpoint);
+        if (encodedParams.isEmpty())
+            return m_local->get(path);
+        QByteArray query;
+        query.reserve(path.size() + 1 + encodedParams.size());
+        query += path;
+        query += '?';
+        query += encodedParams;
+        return m_local->get(query);
+    } else if (m_local && method == POST) {
+        return m_local->post(target(endpoint), "application/x-www-form-urlencoded", encodedParams);
+    }
 
     QNetworkReply *reply = 0;
 
-    if (method == GET) {
-        url.setQuery(parameterListToString(params));
-        req.setUrl(url);
+    if (method == DOWNLOAD) {
+        // file paths are not worth caching
+        QNetworkRequest req(buildUrl(endpoint, method));
+        req.setSslConfiguration(m_sslConfig);
+        reply = m_nam->get(req);
+    } else if (method == GET) {
+        QNetworkRequest req = prototype(endpoint);
+        if (!encodedParams.isEmpty()) {
+            QUrl url = req.url();
+            url.setQuery(QString::fromLatin1(encodedParams));
+            req.setUrl(url);
+        }
         reply = m_nam->get(req);
     } else if (method == POST) {
+        QNetworkRequest req = prototype(endpoint);
         req.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-        reply = m_nam->post(req, parameterListToString(params));
-    } else if (method == UPLOAD) {
-        QByteArray boundary = generateMultipartBoundary(params);
-        req.setHeader(QNetworkRequest::ContentTypeHeader, "multipart/form-data; boundary=" + boundary);
-        QByteArray requestData = generateMultipartFormData(params, boundary);
-        req.setHeader(QNetworkRequest::ContentLengthHeader, requestData.length());
-        reply = m_nam->post(req, requestData);
+        reply = m_nam->post(req, encodedParams);
     } else {
-        qCCritical(CTelNet, "No valid method!");
+        qCCritical(CTelNet, "Pre-encoded parameters only work with GET or POST!");
     }
 
     if (reply == NULL) {
         qCWarning(CTelNet, "Reply is NULL");
     }
 
-    /*
-    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    loop.exec();
+    return reply;
+}
 
-    if (reply->error() != QNetworkReply::NoError) {
-        qCritical("%s", qPrintable(QString("[%1] %2").arg(reply->error()).arg(reply->errorString())));
-        delete reply;
-        return QByteArray();
+quint64 Networking::enqueue(const QString &endpoint, const RequestBuilder &params, Networking::Method method, Networking::Priority priority, qint64 deadline)
+{
+    Queued request;
+    request.endpoint = endpoint;
+    request.method = method;
+    if (method == UPLOAD && params.hasStreamedFiles()) {
+        request.streamed = params;
+    } else if (method == UPLOAD) {
+        request.boundary = params.multipartBoundary();
+        request.body = params.multipart(request.boundary);
+    } else {
+        request.body = params.encoded();
     }
+    return schedule(request, priority, deadline);
+}
 
-    QByteArray ret = reply->readAll();
-    delete reply;
-    return ret;
-    */
-    return reply;
+quint64 Networking::enqueue(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method, Networking::Priority priority, qint64 deadline)
+{
+    Queued request;
+    request.endpoint = endpoint;
+    request.method = method;
+    request.body = encodedParams;
+    return schedule(request, priority, deadline);
 }
 
-QUrl Networking::buildUrl(QString endpoint) const
+quint64 Networking::schedule(Queued &request, Networking::Priority priority, qint64 deadline)
 {
-    QUrl url = QUrl();
-    url.setScheme("https");
-    url.setHost(API_HOST);
-    url.setPath("/bot" + m_token + endpoint);
+    if (priority < Interactive || priority >= PriorityCount)
+        priority = Normal;
 
-    return url;
+    request.id = ++m_nextRequestId;
+    request.deadline = deadline > 0 ? msecsElapsed() + deadline : 0;
+    request.updateId = m_tracer.currentUpdate();
+    request.traceQueued = m_tracer.isEnabled() ? m_tracer.now() : 0;
+    m_lanes[priority].enqueue(request);
+    m_metrics.setQueueDepth(priority, m_lanes[priority].size());
+
+    // sending is deferred, so requestCompleted never fires before the caller knows the id
+    schedulePump();
+    return request.id;
 }
 
-QByteArray Networking::parameterListToString(const ParameterList &list) const
+bool Networking::cancel(quint64 id)
 {
-    QByteArray ret;
+    for (int lane = 0; lane < PriorityCount; ++lane) {
+        for (int i = 0; i < m_lanes[lane].size(); ++i) {
+            if (m_lanes[lane].at(i).id != id)
+                continue;
+            m_lanes[lane].removeAt(i);
+            m_metrics.setQueueDepth(lane, m_lanes[lane].size());
+            // like dropped requests, never complete within the caller
+            QTimer::singleShot(0, this, [this, id]() { emit requestCompleted(id, 0); });
+            return true;
+        }
+    }
 
-    ParameterList::const_iterator i = list.begin();
-    while (i != list.end()) {
-        ret.append(i.key() + "=" + i.value().value + "&");
-        ++i;
+    for (auto it = m_started.begin(); it != m_started.end(); ++it) {
+        if (it.value().scheduled && it.value().id == id) {
+            // finished is signaled from abort(), requestCompleted follows with OperationCanceledError
+            it.key()->abort();
+            return true;
+        }
     }
-    ret = ret.left(ret.length() - 1);
+    return false;
+}
 
-    return ret;
+void Networking::cancelQueued()
+{
+    QVector<quint64> ids;
+    for (int lane = 0; lane < PriorityCount; ++lane) {
+        while (!m_lanes[lane].isEmpty())
+            ids.append(m_lanes[lane].dequeue().id);
+        m_metrics.setQueueDepth(lane, 0);
+    }
+    if (ids.isEmpty())
+        return;
+    QTimer::singleShot(0, this, [this, ids]() {
+        foreach (quint64 id, ids)
+            emit requestCompleted(id, 0);
+    });
 }
 
-QByteArray Networking::generateMultipartBoundary(const ParameterList &list) const
+void Networking::setMaxInFlight(int max)
 {
-    // Generates a boundary that is not existent in the data
-    QByteArray result;
+    m_maxInFlight = qMax(1, max);
+    schedulePump();
+}
 
-    srand((unsigned int) time(NULL));
-    ParameterList::const_iterator i = list.begin();
-    while (i != list.end()) {
-        if (i.value().isFile) {
-            while (result.isEmpty() || i.value().value.contains(result)) {
-                result.append(generateRandomString(4));
-            }
-        }
-        ++i;
-    }
+void Networking::setLaneWeights(int normal, int bulk)
+{
+    m_weights[Normal] = qMax(1, normal);
+    m_weights[Bulk] = qMax(1, bulk);
+}
 
-    return result;
+void Networking::schedulePump()
+{
+    if (m_pumpPending)
+        return;
+    m_pumpPending = true;
+    QMetaObject::invokeMethod(this, "pump", Qt::QueuedConnection);
 }
 
-QByteArray Networking::generateMultipartFormData(const ParameterList &list, const QByteArray &boundary) const
+int Networking::nextLane()
 {
-    QByteArray result;
+    // the last slot is reserved for interactive requests
+    if (!m_lanes[Interactive].isEmpty() && m_scheduledInFlight < m_maxInFlight)
+        return Interactive;
+    if (m_scheduledInFlight >= qMax(1, m_maxInFlight - 1))
+        return -1;
 
-    ParameterList::const_iterator i = list.begin();
-    while (i != list.end()) {
-        HttpParameter param = i.value();
-        result.append("--" + boundary + "\r\n");
-        result.append("Content-Disposition: form-data; name=\"" + i.key());
-        if (param.isFile) {
-            result.append("\"; filename=\"" + param.filename);
-        }
-        result.append("\"\r\n");
-        if (param.isFile) {
-            result.append("Content-Type: " + param.mimeType + "\r\n");
+    // smooth weighted round robin between the waiting lanes
+    int total = 0;
+    int best = -1;
+    for (int lane = Normal; lane < PriorityCount; ++lane) {
+        if (m_lanes[lane].isEmpty())
+            continue;
+        m_credits[lane] += m_weights[lane];
+        total += m_weights[lane];
+        if (best < 0 || m_credits[lane] > m_credits[best])
+            best = lane;
+    }
+    if (best >= 0)
+        m_credits[best] -= total;
+    return best;
+}
+
+void Networking::pump()
+{
+    m_pumpPending = false;
+
+    int lane;
+    while ((lane = nextLane()) >= 0) {
+        Queued request = m_lanes[lane].dequeue();
+        m_metrics.setQueueDepth(lane, m_lanes[lane].size());
+
+        if (request.deadline && msecsElapsed() > request.deadline) {
+            qCDebug(CTelNet) << "dropping request past its deadline" << request.endpoint << request.id;
+            m_metrics.recordDropped(statsName(request.endpoint, request.method));
+            emit requestCompleted(request.id, 0);
+            continue;
         }
-        result.append("\r\n");
-        result.append(param.value);
-        result.append("\r\n");
 
-        ++i;
+        if (request.traceQueued)
+            m_tracer.complete("queued", "net", request.traceQueued, m_tracer.now(), request.updateId, request.id, request.endpoint);
+
+#ifdef DEBUG
+        qCDebug(CTelNet, "HTTP request: %s %d lane %d %d bytes", qUtf8Printable(buildUrl(request.endpoint).toString()), request.method, lane, request.body.size());
+#endif
+
+        const bool streamed = request.method == UPLOAD && request.streamed.hasStreamedFiles();
+        QNetworkReply *reply = streamed ? sendMultipart(request.endpoint, request.streamed) :
+                    request.method == UPLOAD ? sendMultipart(request.endpoint, request.boundary, request.body) :
+                    send(request.endpoint, request.body, request.method);
+        if (!reply) {
+            emit requestCompleted(request.id, 0);
+            continue;
+        }
+        ++m_scheduledInFlight;
+        track(reply, statsName(request.endpoint, request.method), streamed ? request.streamed.contentSize() : request.body.size(), request.id, request.updateId, true);
     }
-    result.append("--" + boundary + "--");
+}
+
+void Networking::track(QNetworkReply *reply, const QString &endpoint, qint64 bytesOut, quint64 id, quint64 updateId, bool scheduled)
+{
+    Started started;
+    started.stats = m_metrics.requestStarted(endpoint, bytesOut);
+    started.nsec = m_metrics.nsecsElapsed();
+    started.id = id;
+    started.updateId = updateId;
+    started.traceStart = m_tracer.isEnabled() ? m_tracer.now() : 0;
+    started.bytesIn = -1;
+    started.scheduled = scheduled;
+    m_started.insert(reply, started);
+    // streamed replies are consumed while they arrive, count what was received instead of what is left
+    connect(reply, &QNetworkReply::downloadProgress, this, [this, reply](qint64 received, qint64) {
+        auto it = m_started.find(reply);
+        if (it != m_started.end())
+            it.value().bytesIn = received;
+    });
+}
+
+void Networking::setLocalServer(const QString &address)
+{
+    delete m_local;
+    m_local = 0;
+    if (address.isEmpty())
+        return;
+    m_local = new LocalTransport(address, this);
+    connect(m_local, &LocalTransport::finished, this, &Networking::replyFinished);
+}
+
+void Networking::warmUp(int connections)
+{
+    if (m_local)
+        return; // nothing worth warming up
+
+    connections = qBound(1, connections, 6);
+    for (int i = 0; i < connections; ++i)
+        m_nam->connectToHostEncrypted(API_HOST, 443, m_sslConfig);
+}
+
+void Networking::setTlsSessionCache(const QString &fileName)
+{
+    m_sessionCacheFile = fileName;
+    // session tickets are only handed out with persistence enabled
+    m_sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly))
+        m_sslConfig.setSessionTicket(file.readAll());
+    m_prototypes.clear();
+}
+
+void Networking::storeSessionTicket(QNetworkReply *reply)
+{
+    const QByteArray ticket = reply->sslConfiguration().sessionTicket();
+    if (ticket.isEmpty() || ticket == m_sslConfig.sessionTicket())
+        return;
+    m_sslConfig.setSessionTicket(ticket);
+    m_prototypes.clear();
 
-    return result;
+    QSaveFile file(m_sessionCacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "could not open" << m_sessionCacheFile << file.errorString();
+        return;
+    }
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    file.write(ticket);
+    file.commit();
 }
 
-QString Networking::generateRandomString(int length) const
+void Networking::replyFinished(QNetworkReply *reply)
 {
-    static const std::string chars("qwertyuiopasdfghjklzxcvbnmQWERTYUIOPASDFGHJKLZXCVBNM1234567890-=[]\\;',./!@#$%^&*()_+{}|:\"<>?`~");
-    static const size_t charsLen = chars.length();
-    QString result;
-    for (int i = 0; i < length; ++i) {
-        result += QChar(chars[rand() % charsLen]);
+    if (!m_sessionCacheFile.isEmpty() && reply->error() == QNetworkReply::NoError)
+        storeSessionTicket(reply);
+
+    quint64 updateId = 0;
+    quint64 id = 0;
+    bool scheduled = false;
+    auto it = m_started.find(reply);
+    const QString path = reply->url().path();
+    if (it == m_started.end() && !path.startsWith(QLatin1String("/bot")) && !path.startsWith(QLatin1String("/file/bot"))) {
+        // connection opened by warmUp, QNetworkAccessManager deletes it
+        return;
+    }
+    if (it != m_started.end()) {
+        // -1 (unknown, recorded as 0) if nothing was received
+        QVariant length = reply->header(QNetworkRequest::ContentLengthHeader);
+        qint64 bytesIn = it.value().bytesIn >= 0 ? it.value().bytesIn : length.isValid() ? length.toLongLong() : -1;
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        m_metrics.requestFinished(it.value().stats, it.value().nsec, bytesIn, status, reply->error() != QNetworkReply::NoError);
+        updateId = it.value().updateId;
+        id = it.value().id;
+        scheduled = it.value().scheduled;
+        if (m_tracer.isEnabled() && it.value().traceStart)
+            m_tracer.complete("request", "net", it.value().traceStart, m_tracer.now(), updateId, id, it.value().stats->name);
+        m_started.erase(it);
+    }
+
+    // callbacks of the reply belong to the update that caused the request
+    const quint64 previousUpdate = m_tracer.currentUpdate();
+    m_tracer.setCurrentUpdate(updateId);
+    if (scheduled) {
+        --m_scheduledInFlight;
+        emit requestCompleted(id, reply);
+        schedulePump();
+    } else {
+        emit requestFinished(reply);
     }
-    return result;
+    m_tracer.setCurrentUpdate(previousUpdate);
+}
+
+QNetworkRequest Networking::prototype(const QString &endpoint)
+{
+    auto it = m_prototypes.constFind(endpoint);
+    if (it != m_prototypes.constEnd())
+        return it.value();
+
+    QNetworkRequest req(buildUrl(endpoint));
+    req.setSslConfiguration(m_sslConfig);
+    m_prototypes.insert(endpoint, req);
+    return req;
+}
+
+const QByteArray &Networking::target(const QString &endpoint)
+{
+    auto it = m_targets.find(endpoint);
+    if (it == m_targets.end())
+        it = m_targets.insert(endpoint, buildTarget(endpoint));
+    return it.value();
+}
+
+QByteArray Networking::buildTarget(const QString &endpoint, Method method) const
+{
+    if (method == DOWNLOAD)
+        return "/file/bot" + m_token.toLatin1() + '/' + QUrl::toPercentEncoding(endpoint, "/");
+    return "/bot" + m_token.toLatin1() + endpoint.toLatin1();
+}
+
+QUrl Networking::buildUrl(QString endpoint, Method method) const
+{
+    QUrl url = QUrl();
+    url.setScheme("https");
+    url.setHost(API_HOST);
+    if (method == DOWNLOAD)
+        url.setPath("/file/bot" + m_token + '/' + endpoint);
+    else
+        url.setPath("/bot" + m_token + endpoint);
+
+    return url;
+}
+
+QByteArray Networking::parameterListToString(const ParameterList &list) const
+{
+    return RequestBuilder(list).encoded();
 }
@@ -7,9 +7,20 @@
 #include <QNetworkReply>
 #include <QEventLoop>
 #include <QLoggingCategory>
+#include <QHash>
+#include <QQueue>
+#include <QSslConfiguration>
+
+#include "requestbuilder.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "localtransport.h"
 
 #define API_HOST "api.telegram.org"
 
+// GET requests with longer parameter lists are sent as POST instead
+#define MAX_QUERY_LENGTH 1024
+
 #define ENDPOINT_GET_ME                     "/getMe"
 #define ENDPOINT_SEND_MESSAGE               "/sendMessage"
 #define ENDPOINT_FORWARD_MESSAGE            "/forwardMessage"
@@ -27,6 +38,8 @@
 #define ENDPOINT_GET_FILE                   "/getFile"
 #define ENDPOINT_SET_CHAT_TITLE             "/setChatTitle"
 #define ENDPOINT_GET_CHAT                   "/getChat"
+#define ENDPOINT_ANSWER_CALLBACK_QUERY      "/answerCallbackQuery"
+#define ENDPOINT_ANSWER_INLINE_QUERY        "/answerInlineQuery"
 
 namespace Telegram {
 Q_DECLARE_LOGGING_CATEGORY(CTelNet)
@@ -35,19 +48,30 @@ class HttpParameter {
 public:
     HttpParameter() = delete; //  : isFile(false) {}
     HttpParameter(const QVariant &aValue, bool aIsFile = false, QString aMimeType = "text/plain", QString aFilename = "") :
-        isFile(aIsFile), mimeType(aMimeType), filename(aFilename) {
+        isFile(aIsFile), isEncoded(false), mimeType(aMimeType), filename(aFilename) {
         if (aValue.canConvert<QByteArray>())
             value = aValue.toByteArray();
         else
             qWarning() << __PRETTY_FUNCTION__ << "can't convert" << aValue;
     }
 
+    /**
+     * Parameter whose value is already percent encoded and is appended to url encoded requests as is.
+     */
+    static HttpParameter encoded(const QByteArray &aValue) {
+        HttpParameter p(aValue);
+        p.isEncoded = true;
+        return p;
+    }
+
     QByteArray value;
     bool isFile;
+    bool isEncoded;
     QString mimeType;
     QString filename;
 };
 
+// legacy parameter list, prefer RequestBuilder
 typedef QMap<QString, HttpParameter> ParameterList;
 
 class Networking : public QObject
@@ -57,24 +81,161 @@ public:
     Networking(const QString &token, QObject *parent = 0);
     ~Networking();
 
-    enum Method { GET=1, POST, UPLOAD };
+    /**
+     * DOWNLOAD fetches a file, the endpoint is the file_path returned by getFile.
+     */
+    enum Method { GET=1, POST, UPLOAD, DOWNLOAD };
+
+    /**
+     * Lanes of scheduled requests. Interactive requests are always started first and one slot is
+     * kept free for them, Normal and Bulk share the remaining slots by weight.
+     */
+    enum Priority { Interactive = 0, Normal, Bulk, PriorityCount };
 
     //QByteArray request(const QString &endpoint, const ParameterList &params, Method method);
     QNetworkReply *asyncRequest(const QString &endpoint, const ParameterList &arams, Method method); // signaled requestFinished afterwards
+    QNetworkReply *asyncRequest(const QString &endpoint, const RequestBuilder &params, Method method);
+    QNetworkReply *asyncRequest(const QString &endpoint, const QByteArray &encodedParams, Method method); // GET or POST with already encoded parameters
+
+    /**
+     * Queues a request in the lane of priority, it is sent once a slot is free.
+     * @param deadline - msec from now after which the request is dropped instead of sent late, 0 for none
+     * @return request id, signaled by requestCompleted afterwards
+     */
+    quint64 enqueue(const QString &endpoint, const RequestBuilder &params, Method method, Priority priority = Normal, qint64 deadline = 0);
+    quint64 enqueue(const QString &endpoint, const QByteArray &encodedParams, Method method, Priority priority = Normal, qint64 deadline = 0);
+
+    /**
+     * Removes a queued request or aborts its reply if it is already running.
+     * requestCompleted is signaled with a null or aborted reply.
+     * @return false if id is unknown or already finished
+     */
+    bool cancel(quint64 id);
+
+    /**
+     * Removes all queued requests of all lanes, running ones are left alone.
+     * requestCompleted is signaled with a null reply for each of them.
+     */
+    Q_INVOKABLE void cancelQueued();
+
+    /**
+     * @param max - scheduled requests running at the same time. QNetworkAccessManager opens up to
+     * six connections per host and long polling keeps one of them busy, hence the default of 5.
+     */
+    void setMaxInFlight(int max);
+
+    /**
+     * Share of Normal and Bulk requests when both lanes are waiting, default 4:1.
+     */
+    void setLaneWeights(int normal, int bulk);
+
+    int queued(Priority priority) const { return m_lanes[priority].size(); }
+
+    /**
+     * Opens connections to the api host ahead of the first request, so DNS lookup, TCP and TLS
+     * handshakes and backend initialization are done when it is sent.
+     * @param connections - at most 6, the connections QNetworkAccessManager keeps per host
+     */
+    Q_INVOKABLE void warmUp(int connections);
+
+    /**
+     * Persists the TLS session ticket of the api host in fileName, so handshakes after a restart
+     * resume the session instead of doing a full handshake. The file is only readable by the owner.
+     * Call before the first request.
+     */
+    Q_INVOKABLE void setTlsSessionCache(const QString &fileName);
+
+    /**
+     * Sends all requests to a self-hosted Bot API server on the same host through LocalTransport,
+     * plain HTTP without QNetworkAccessManager. Files of streamed uploads are read into memory,
+     * see addFilePath.
+     * @param address - path of a Unix domain socket or host:port, empty to use api.telegram.org again
+     */
+    Q_INVOKABLE void setLocalServer(const QString &address);
+
+    QByteArray parameterListToString(const ParameterList &list) const;
+
+    /**
+     * Request counts, latencies, sizes and errors, recorded for every request.
+     */
+    Metrics *metrics() { return &m_metrics; }
+
+    /**
+     * Records a span per request, tagged with the update being processed when it was sent.
+     */
+    Tracer *tracer() { return &m_tracer; }
 
 private:
     QNetworkAccessManager *m_nam;
     QString m_token;
-
-    QUrl buildUrl(QString endpoint) const;
-    QByteArray parameterListToString(const ParameterList &list) const;
-
-    QByteArray generateMultipartBoundary(const ParameterList &list) const;
-    QByteArray generateMultipartFormData(const ParameterList &list, const QByteArray &boundary) const;
-    QString generateRandomString(int length) const;
+    QSslConfiguration m_sslConfig; // used for all requests, carries the session ticket
+    QString m_sessionCacheFile;
+    LocalTransport *m_local; // 0 unless setLocalServer
+    // url and TLS configuration per endpoint, built once and copied (implicitly shared) per request
+    QHash<QString, QNetworkRequest> m_prototypes;
+    QHash<QString, QByteArray> m_targets; // same for m_local
+    Metrics m_metrics;
+    Tracer m_tracer;
+    quint64 m_nextRequestId;
+
+    struct Started {
+        EndpointStats *stats;
+        qint64 nsec;
+        quint64 id;
+        quint64 updateId; // update dispatched while the request was sent
+        qint64 traceStart;
+        qint64 bytesIn; // body bytes received so far, -1 until the first
+        bool scheduled;
+    };
+    QHash<QNetworkReply*, Started> m_started;
+
+    struct Queued {
+        quint64 id;
+        QString endpoint;
+        QByteArray body;
+        QByteArray boundary; // multipart uploads only
+        RequestBuilder streamed; // uploads of files read while sending, body is empty then
+        Method method;
+        qint64 deadline; // msec of the metrics clock, 0 for none
+        quint64 updateId;
+        qint64 traceQueued;
+    };
+    QQueue<Queued> m_lanes[PriorityCount];
+    int m_weights[PriorityCount];
+    int m_credits[PriorityCount];
+    int m_maxInFlight;
+    int m_scheduledInFlight;
+    bool m_pumpPending;
+
+    QUrl buildUrl(QString endpoint, Method method = GET) const;
+    QByteArray buildTarget(const QString &endpoint, Method method = GET) const; // path for m_local
+    QNetworkRequest prototype(const QString &endpoint);
+    const QByteArray &target(const QString &endpoint);
+    // downloads are recorded together instead of per file path
+    static QString statsName(const QString &endpoint, Method method) { return method == DOWNLOAD ? QStringLiteral("/file") : endpoint; }
+    void storeSessionTicket(QNetworkReply *reply);
+    QNetworkReply *send(const QString &endpoint, const QByteArray &encodedParams, Method method);
+    QNetworkReply *sendMultipart(const QString &endpoint, const QByteArray &boundary, const QByteArray &data);
+    QNetworkReply *sendMultipart(const QString &endpoint, const RequestBuilder &params);
+    void track(QNetworkReply *reply, const QString &endpoint, qint64 bytesOut, quint64 id, quint64 updateId, bool scheduled);
+    quint64 schedule(Queued &request, Priority priority, qint64 deadline);
+    void schedulePump();
+    int nextLane();
+    qint64 msecsElapsed() const { return m_metrics.nsecsElapsed() / 1000000; }
+
+private slots:
+    void replyFinished(QNetworkReply *reply);
+    void pump();
 
 signals:
     void requestFinished(QNetworkReply *reply); // calle reply->deleteLater() once done with the reply!
+
+    /**
+     * Signaled for requests passed to enqueue().
+     * @param reply - 0 if the request was dropped at its deadline or could not be sent, otherwise
+     * call reply->deleteLater() once done with it
+     */
+    void requestCompleted(quint64 id, QNetworkReply *reply);
 };
 
 }
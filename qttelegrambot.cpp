@@ -1,5 +1,6 @@
 #include <QThread>
 #include <QCoreApplication>
+#include <QFileInfo>
 #include "qttelegrambot.h"
 
 using namespace Telegram;
@@ -7,22 +8,58 @@ using namespace Telegram;
 Q_LOGGING_CATEGORY(Telegram::CTelBot, "telegram.bot")
 
 Bot::Bot(const QString &token, bool updates, quint32 updateInterval, quint32 pollingTimeout, QObject *parent) :
+    Bot(token, SameThread, updates, updateInterval, pollingTimeout, parent)
+{
+}
+
+Bot::Bot(const QString &token, IoMode ioMode, bool updates, quint32 updateInterval, quint32 pollingTimeout, QObject *parent) :
     QObject(parent),
     m_net(new Networking(token)),
+    m_ioThread(0),
+    m_ioWorker(0),
+    m_nextTicket(0),
+    m_localMode(false),
     m_internalUpdateTimer(new QTimer(this)),
     m_updateInterval(updateInterval),
     m_updateOffset(0),
-    m_pollingTimeout(pollingTimeout)
+    m_pollingTimeout(pollingTimeout),
+    m_pollBatch(0),
+    m_dispatching(0),
+    m_resultCache(ResultCacheSize),
+    m_resultCacheTtl(0)
 {
+    m_clock.start();
     QLoggingCategory::setFilterRules("qt.network.ssl.warning=false");
 
+    for (int i = 0; i < Networking::PriorityCount; ++i)
+        m_deadlines[i] = 0;
+
+    if (ioMode == IoThread) {
+        m_ioWorker = new IoWorker(m_net, this);
+        m_ioThread = new QThread(this);
+        m_ioThread->setObjectName("telegram-io");
+        m_net->moveToThread(m_ioThread);
+        m_ioWorker->moveToThread(m_ioThread);
+        m_ioThread->start();
+        if (updates) {
+            // after the settings made right after construction reached the worker
+            QTimer::singleShot(0, this, [this, updateInterval, pollingTimeout]() {
+                QMetaObject::invokeMethod(m_ioWorker, "startPolling", Qt::QueuedConnection,
+                                          Q_ARG(quint32, updateInterval), Q_ARG(quint32, pollingTimeout));
+            });
+        }
+        return;
+    }
+
     connect(m_net, SIGNAL(requestFinished(QNetworkReply*)),
             this, SLOT(requestFinished(QNetworkReply*)));
+    connect(m_net, &Networking::requestCompleted, this, &Bot::requestCompleted);
 
     if (updates) {
         m_internalUpdateTimer->setSingleShot(true);
         connect(m_internalUpdateTimer, &QTimer::timeout, this, &Bot::internalGetUpdates);
-        internalGetUpdates();
+        // first poll from the event loop, see warmUp
+        m_internalUpdateTimer->start(0);
     }
 }
 
@@ -33,16 +70,34 @@ Bot::~Bot()
     delete m_internalUpdateTimer;
     m_internalUpdateTimer = 0;
 
-    if (_pendingReplies.size()) {
-        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "got replies pending" << _pendingReplies.size();
-        while (_pendingReplies.size()) {
+    // nothing new gets queued, queued requests are dropped, only started ones are waited for
+    foreach (Broadcast *broadcast, findChildren<Broadcast *>(QString(), Qt::FindDirectChildrenOnly))
+        broadcast->pause();
+    if (m_ioWorker)
+        QMetaObject::invokeMethod(m_net, "cancelQueued", Qt::BlockingQueuedConnection);
+    else
+        m_net->cancelQueued();
+
+    if (_pendingReplies.size() || m_pendingRequests.size()) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "got replies pending" << _pendingReplies.size() + m_pendingRequests.size();
+        while (_pendingReplies.size() || m_pendingRequests.size()) {
             QCoreApplication::instance()->processEvents(QEventLoop::AllEvents, 1000);
             QThread::msleep(100);
         }
         qCDebug(CTelBot) << __PRETTY_FUNCTION__ << "processed all replies pending" << _pendingReplies.size();
     }
+
+    if (m_ioThread) {
+        QMetaObject::invokeMethod(m_ioWorker, "stop", Qt::QueuedConnection);
+        m_ioThread->wait();
+        delete m_ioWorker;
+        delete m_net;
+        return;
+    }
+
     disconnect(m_net, SIGNAL(requestFinished(QNetworkReply*)),
                this, SLOT(requestFinished(QNetworkReply*)));
+    disconnect(m_net, &Networking::requestCompleted, this, &Bot::requestCompleted);
 
     delete m_net;
 }
@@ -65,55 +120,250 @@ void Bot::requestFinished(QNetworkReply *reply)
     }
 }
 
+void Bot::requestCompleted(quint64 id, QNetworkReply *reply)
+{
+    auto it = m_pendingRequests.find(id);
+    if (it != m_pendingRequests.end()) {
+        std::function<void(QNetworkReply*)> fn = it.value();
+        m_pendingRequests.erase(it);
+        fn(reply);
+    } else {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "couldnt find request in pendingRequests!" << id;
+    }
+    if (reply)
+        reply->deleteLater();
+}
+
+void Bot::drainIoEvents()
+{
+    m_ioWorker->eventsDrained();
+
+    IoEvent event;
+    while (m_ioWorker->takeEvent(event)) {
+        if (event.kind == IoEvent::Update) {
+            if (m_executor) {
+                const QJsonObject obj = event.update;
+                m_executor([this, obj]() { processUpdate(obj); });
+            } else {
+                processUpdate(event.update);
+            }
+            continue;
+        }
+
+        QNetworkReply *reply = 0;
+        if (!event.dropped)
+            reply = new BufferedReply(event.body, QNetworkReply::NetworkError(event.error), event.errorString, event.httpStatus);
+        // callbacks belong to the update that caused the request
+        Tracer *tracer = m_net->tracer();
+        const quint64 previousUpdate = tracer->currentUpdate();
+        tracer->setCurrentUpdate(event.updateId);
+        requestCompleted(event.ticket, reply);
+        tracer->setCurrentUpdate(previousUpdate);
+    }
+}
+
+void Bot::warmUp(int connections)
+{
+    if (m_ioWorker)
+        QMetaObject::invokeMethod(m_net, "warmUp", Qt::QueuedConnection, Q_ARG(int, connections));
+    else
+        m_net->warmUp(connections);
+    asyncGetMe();
+}
+
+void Bot::setTlsSessionCache(const QString &fileName)
+{
+    if (m_ioWorker)
+        QMetaObject::invokeMethod(m_net, "setTlsSessionCache", Qt::QueuedConnection, Q_ARG(QString, fileName));
+    else
+        m_net->setTlsSessionCache(fileName);
+}
+
+void Bot::setLocalServer(const QString &address)
+{
+    if (m_ioWorker)
+        QMetaObject::invokeMethod(m_net, "setLocalServer", Qt::QueuedConnection, Q_ARG(QString, address));
+    else
+        m_net->setLocalServer(address);
+}
+
+void Bot::setHandlerExecutor(Executor executor)
+{
+    m_executor = executor;
+}
+
+quint64 Bot::_enqueue(const QString &endpoint, const RequestBuilder &params, Networking::Method method, Networking::Priority priority, qint64 deadline)
+{
+    if (!m_ioWorker)
+        return m_net->enqueue(endpoint, params, method, priority, deadline);
+
+    IoCommand command;
+    command.ticket = ++m_nextTicket;
+    command.endpoint = endpoint;
+    command.params = params;
+    command.useBuilder = true;
+    command.method = method;
+    command.priority = priority;
+    command.deadline = deadline;
+    command.updateId = m_net->tracer()->currentUpdate();
+    m_ioWorker->post(command);
+    return command.ticket;
+}
+
+quint64 Bot::_enqueue(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method, Networking::Priority priority, qint64 deadline)
+{
+    if (!m_ioWorker)
+        return m_net->enqueue(endpoint, encodedParams, method, priority, deadline);
+
+    IoCommand command;
+    command.ticket = ++m_nextTicket;
+    command.endpoint = endpoint;
+    command.encoded = encodedParams;
+    command.method = method;
+    command.priority = priority;
+    command.deadline = deadline;
+    command.updateId = m_net->tracer()->currentUpdate();
+    m_ioWorker->post(command);
+    return command.ticket;
+}
+
 bool Bot::asyncGetMe()
 {
-    auto reply = m_net->asyncRequest(ENDPOINT_GET_ME, ParameterList(), Networking::GET);
-    if (!reply) return false;
-    _pendingReplies.insert(std::make_pair(reply,
-                                          [this](QNetworkReply *reply) {
-                               if (reply->error() != QNetworkReply::NoError) {
-                                   qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2 %3").arg(reply->error()).arg(reply->errorString()).arg(reply->readAll().toStdString().c_str())));
-                                   return; // todo emit empty/unknown user here!
-                               }
-                               QByteArray arr = reply->readAll();
-                               QJsonObject json = jsonObjectFromByteArray(arr);
-                               User ret;
-                               ret.id = json.value("id").toInt();
-                               ret.firstname = json.value("first_name").toString();
-                               ret.lastname = json.value("last_name").toString();
-                               ret.username = json.value("username").toString();
-                               if (ret.id == 0 || ret.firstname.isEmpty()) {
-                                   qCCritical(CTelBot, "%s", qPrintable("Got invalid user in " + QString(ENDPOINT_GET_ME)));
-                                   emit getMe(User());
-                               } else
-                               emit getMe(ret);
-                           }
-                               ));
-    return true;
+    return asyncGetMe(UserCallback());
+}
+
+bool Bot::asyncGetMe(UserCallback fn)
+{
+    return _sharedRequest(ENDPOINT_GET_ME, RequestBuilder(), [this, fn](bool ok, const QByteArray &body) {
+        if (!ok) {
+            if (fn) fn(false, User());
+            return; // todo emit empty/unknown user here!
+        }
+        QJsonObject json = jsonObjectFromByteArray(body);
+        User ret(json);
+        if (ret.id == 0 || ret.firstname.isEmpty()) {
+            qCCritical(CTelBot, "%s", qPrintable("Got invalid user in " + QString(ENDPOINT_GET_ME)));
+            emit getMe(User());
+            if (fn) fn(false, User());
+        } else {
+            emit getMe(ret);
+            if (fn) fn(true, ret);
+        }
+    });
 }
 
 bool Bot::asyncGetChat(const QVariant &chatId)
 {
-    ParameterList params;
-    params.insert("chat_id", HttpParameter(chatId));
+    return asyncGetChat(ChatId(chatId.toString()), ChatCallback());
+}
 
-    auto reply = m_net->asyncRequest(ENDPOINT_GET_CHAT, params, Networking::GET);
-    if (!reply) return false;
-    _pendingReplies.insert(std::make_pair(reply,
-                                          [this](QNetworkReply *reply) {
-                               if (reply->error() != QNetworkReply::NoError) {
-                                   qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2").arg(reply->error()).arg(reply->errorString())));
-                                   return; // todo emit empty/unknown user here!
-                               }
-                               QByteArray arr = reply->readAll();
-                               QJsonObject json = jsonObjectFromByteArray(arr);
-                               qCDebug(CTelBot) << __PRETTY_FUNCTION__ << json;
-                               emit gotObject(json);
-                           }
-                               ));
+bool Bot::asyncGetChat(const ChatId &chatId, ChatCallback fn)
+{
+    RequestBuilder params;
+    params.add("chat_id", chatId);
+
+    return _sharedRequest(ENDPOINT_GET_CHAT, params, [this, fn](bool ok, const QByteArray &body) {
+        if (!ok) {
+            if (fn) fn(false, Chat());
+            return;
+        }
+        QJsonObject json = jsonObjectFromByteArray(body);
+        qCDebug(CTelBot) << __PRETTY_FUNCTION__ << json;
+        emit gotObject(json);
+        Chat chat(json);
+        emit gotChat(chat);
+        if (fn) fn(chat.id != 0, chat);
+    });
+}
+
+bool Bot::asyncGetFile(const QString &fileId, FileCallback fn)
+{
+    RequestBuilder params;
+    params.add("file_id", fileId);
+
+    return _sharedRequest(ENDPOINT_GET_FILE, params, [this, fn](bool ok, const QByteArray &body) {
+        if (!ok) {
+            if (fn) fn(false, File(QString()));
+            return;
+        }
+        QJsonObject json = jsonObjectFromByteArray(body);
+        File file(json.value("file_id").toString(), qint64(json.value("file_size").toDouble(-1)), json.value("file_path").toString());
+        if (fn) fn(!file.fileId.isEmpty(), file);
+    });
+}
+
+bool Bot::downloadFile(const File &file, DownloadCallback fn)
+{
+    // callbacks always run from the event loop, failures included
+    auto fail = [this, fn]() {
+        if (fn)
+            QTimer::singleShot(0, this, [fn]() { fn(false, std::shared_ptr<MappedFile>()); });
+    };
+
+    if (file.filePath.isEmpty()) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "file without path" << file;
+        fail();
+        return false;
+    }
+
+    if (file.isLocal()) {
+        if (!m_localMode) {
+            qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "absolute file path without local mode" << file.filePath;
+            fail();
+            return false;
+        }
+        std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>(file.filePath);
+        if (!mapped->isValid() || mapped->data().size() != mapped->size()) {
+            qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "could not map" << file.filePath << mapped->errorString();
+            fail();
+            return false;
+        }
+        if (fn)
+            QTimer::singleShot(0, this, [fn, mapped]() { fn(true, mapped); });
+        return true;
+    }
+
+    call(file.filePath, RequestBuilder(), Networking::DOWNLOAD, [fn](QNetworkReply *reply) {
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            qCWarning(CTelBot) << "downloadFile failed" << (reply ? reply->errorString() : QString("dropped"));
+            if (fn) fn(false, std::shared_ptr<MappedFile>());
+            return;
+        }
+        if (fn) fn(true, std::make_shared<MappedFile>(reply->readAll()));
+    }, currentPriority());
     return true;
 }
 
+bool Bot::asyncGetUserProfilePhotos(qint32 userId, UserProfilePhotosCallback fn, qint16 offset, qint8 limit)
+{
+    RequestBuilder params;
+    params.add("user_id", userId);
+    if (offset > -1) params.add("offset", offset);
+    if (limit > -1) params.add("limit", limit);
+
+    return _sharedRequest(ENDPOINT_GET_USER_PROFILE_PHOTOS, params, [this, fn](bool ok, const QByteArray &body) {
+        UserProfilePhotos ret;
+        if (!ok) {
+            if (fn) fn(false, ret);
+            return;
+        }
+        QJsonObject json = jsonObjectFromByteArray(body);
+        foreach (QJsonValue val, json.value("photos").toArray()) {
+            QList<PhotoSize> photo;
+            foreach (QJsonValue p, val.toArray())
+                photo.append(PhotoSize(p.toObject()));
+            ret.append(photo);
+        }
+        if (fn) fn(json.contains("photos"), ret);
+    });
+}
+
+void Bot::setResultCacheTtl(quint32 msec)
+{
+    m_resultCacheTtl = msec;
+    if (!msec)
+        m_resultCache.clear();
+}
 
 /*
 User Bot::getMe()
@@ -138,21 +388,68 @@ User Bot::getMe()
 
 bool Bot::sendMessage(const ChatId &chatId, const QString &text, bool markdown, bool disableWebPagePreview, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    if (markdown) params.insert("parse_mode", HttpParameter("Markdown"));
-    if (disableWebPagePreview) params.insert("disable_web_page_preview", HttpParameter(disableWebPagePreview));
+    RequestBuilder params;
+    if (markdown) params.add("parse_mode", "Markdown");
+    if (disableWebPagePreview) params.add("disable_web_page_preview", disableWebPagePreview);
 
     return this->_sendPayload(chatId, text, params, replyToMessageId, replyMarkup, "text", ENDPOINT_SEND_MESSAGE);
 }
 
 bool Bot::setChatTitle(const ChatId &chatId, const QString &title)
 {
-    ParameterList params;
+    RequestBuilder params;
 
     return this->_sendPayload(chatId, title, params, 0, GenericReply(), "title", ENDPOINT_SET_CHAT_TITLE);
 }
 
 
+Broadcast *Bot::broadcastMessage(const QVector<ChatId> &chatIds, const QString &text, bool markdown, bool disableWebPagePreview, const GenericReply &replyMarkup)
+{
+    RequestBuilder params;
+    params.add("text", text);
+    if (markdown) params.add("parse_mode", "Markdown");
+    if (disableWebPagePreview) params.add("disable_web_page_preview", disableWebPagePreview);
+    if (replyMarkup.isValid()) params.add("reply_markup", replyMarkup);
+
+    return broadcast(chatIds, ENDPOINT_SEND_MESSAGE, params);
+}
+
+quint64 Bot::call(const QString &endpoint, const RequestBuilder &params, Networking::Method method, std::function<void(QNetworkReply*)> fn, Networking::Priority priority)
+{
+    quint64 id = _enqueue(endpoint, params, method, priority, m_deadlines[priority]);
+    m_pendingRequests.insert(id, fn);
+    return id;
+}
+
+void Bot::cancel(quint64 id)
+{
+    if (!m_ioWorker) {
+        m_net->cancel(id);
+        return;
+    }
+    IoCommand command;
+    command.cancelTicket = id;
+    m_ioWorker->post(command);
+}
+
+Metrics *Bot::metrics() const
+{
+    return m_net->metrics();
+}
+
+Tracer *Bot::tracer() const
+{
+    return m_net->tracer();
+}
+
+Broadcast *Bot::broadcast(const QVector<ChatId> &chatIds, const QString &endpoint, const RequestBuilder &payload)
+{
+    Broadcast *b = new Broadcast(this, endpoint, payload, chatIds, this);
+    connect(b, &Broadcast::finished, b, &QObject::deleteLater);
+    b->start();
+    return b;
+}
+
 /*
 bool Bot::forwardMessage(QVariant chatId, quint32 fromChatId, quint32 messageId)
 {
@@ -172,92 +469,92 @@ bool Bot::forwardMessage(QVariant chatId, quint32 fromChatId, quint32 messageId)
 
 bool Bot::sendPhoto(const ChatId &chatId, QFile *file, QString caption, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    if (!caption.isEmpty()) params.insert("caption", HttpParameter(caption));
+    RequestBuilder params;
+    if (!caption.isEmpty()) params.add("caption", caption);
 
     return this->_sendPayload(chatId, file, params, replyToMessageId, replyMarkup, "photo", ENDPOINT_SEND_PHOTO);
 }
 
 bool Bot::sendPhoto(const ChatId &chatId, QString fileId, QString caption, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    if (!caption.isEmpty()) params.insert("caption", HttpParameter(caption));
+    RequestBuilder params;
+    if (!caption.isEmpty()) params.add("caption", caption);
 
     return this->_sendPayload(chatId, fileId, params, replyToMessageId, replyMarkup, "photo", ENDPOINT_SEND_PHOTO);
 }
 
 bool Bot::sendAudio(const ChatId &chatId, QFile *file, qint64 duration, QString performer, QString title, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    if (duration >= 0) params.insert("duration", HttpParameter(duration));
-    if (!performer.isEmpty()) params.insert("performer", HttpParameter(performer));
-    if (!title.isEmpty()) params.insert("title", HttpParameter(title));
+    RequestBuilder params;
+    if (duration >= 0) params.add("duration", duration);
+    if (!performer.isEmpty()) params.add("performer", performer);
+    if (!title.isEmpty()) params.add("title", title);
 
     return this->_sendPayload(chatId, file, params, replyToMessageId, replyMarkup, "audio", ENDPOINT_SEND_AUDIO);
 }
 
 bool Bot::sendAudio(const ChatId &chatId, QString fileId, qint64 duration, QString performer, QString title, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    if (duration >= 0) params.insert("duration", HttpParameter(duration));
-    if (!performer.isEmpty()) params.insert("performer", HttpParameter(performer));
-    if (!title.isEmpty()) params.insert("title", HttpParameter(title));
+    RequestBuilder params;
+    if (duration >= 0) params.add("duration", duration);
+    if (!performer.isEmpty()) params.add("performer", performer);
+    if (!title.isEmpty()) params.add("title", title);
 
     return this->_sendPayload(chatId, fileId, params, replyToMessageId, replyMarkup, "audio", ENDPOINT_SEND_AUDIO);
 }
 
 bool Bot::sendDocument(const ChatId &chatId, QFile *file, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    return this->_sendPayload(chatId, file, ParameterList(), replyToMessageId, replyMarkup, "document", ENDPOINT_SEND_DOCUMENT);
+    return this->_sendPayload(chatId, file, RequestBuilder(), replyToMessageId, replyMarkup, "document", ENDPOINT_SEND_DOCUMENT);
 }
 
 bool Bot::sendDocument(const ChatId &chatId, QString fileId, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
+    RequestBuilder params;
     return this->_sendPayload(chatId, fileId, params, replyToMessageId, replyMarkup, "document", ENDPOINT_SEND_DOCUMENT);
 }
 
 bool Bot::sendSticker(const ChatId &chatId, QFile *file, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    return this->_sendPayload(chatId, file, ParameterList(), replyToMessageId, replyMarkup, "sticker", ENDPOINT_SEND_STICKER);
+    return this->_sendPayload(chatId, file, RequestBuilder(), replyToMessageId, replyMarkup, "sticker", ENDPOINT_SEND_STICKER);
 }
 
 bool Bot::sendSticker(const ChatId &chatId, QString fileId, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
+    RequestBuilder params;
     return this->_sendPayload(chatId, fileId, params, replyToMessageId, replyMarkup, "sticker", ENDPOINT_SEND_STICKER);
 }
 
 bool Bot::sendVideo(const ChatId &chatId, QFile *file, qint64 duration, QString caption, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    params.insert("duration", HttpParameter(duration));
-    params.insert("caption", HttpParameter(caption));
+    RequestBuilder params;
+    params.add("duration", duration);
+    params.add("caption", caption);
 
     return this->_sendPayload(chatId, file, params, replyToMessageId, replyMarkup, "video", ENDPOINT_SEND_VIDEO);
 }
 
 bool Bot::sendVideo(const ChatId &chatId, QString fileId, qint64 duration, QString caption, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    params.insert("duration", HttpParameter(duration));
-    params.insert("caption", HttpParameter(caption));
+    RequestBuilder params;
+    params.add("duration", duration);
+    params.add("caption", caption);
 
     return this->_sendPayload(chatId, fileId, params, replyToMessageId, replyMarkup, "video", ENDPOINT_SEND_VIDEO);
 }
 
 bool Bot::sendVoice(const ChatId &chatId, QFile *file, qint64 duration, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    params.insert("duration", HttpParameter(duration));
+    RequestBuilder params;
+    params.add("duration", duration);
 
     return this->_sendPayload(chatId, file, params, replyToMessageId, replyMarkup, "voice", ENDPOINT_SEND_VOICE);
 }
 
 bool Bot::sendVoice(const ChatId &chatId, QString fileId, qint64 duration, qint32 replyToMessageId, const GenericReply &replyMarkup)
 {
-    ParameterList params;
-    params.insert("duration", HttpParameter(duration));
+    RequestBuilder params;
+    params.add("duration", duration);
 
     return this->_sendPayload(chatId, fileId, params, replyToMessageId, replyMarkup, "voice", ENDPOINT_SEND_VOICE);
 }
@@ -280,50 +577,67 @@ bool Bot::sendLocation(QVariant chatId, float latitude, float longitude, qint32
 
     return success;
 } */
-/*
-bool Bot::sendChatAction(QVariant chatId, Bot::ChatAction action)
+
+bool Bot::sendChatAction(const ChatId &chatId, Bot::ChatAction action)
 {
-    if (chatId.type() != QVariant::String && chatId.type() != QVariant::Int) {
-        qCritical("Please provide a QString or int as chatId");
+    static const char *const actions[] = { "typing", "upload_photo", "record_video", "upload_video",
+                                           "record_audio", "upload_audio", "upload_document", "find_location" };
+    if (action < Typing || action > FindingLocation)
         return false;
-    }
 
-    ParameterList params;
-    params.insert("chat_id", HttpParameter(chatId));
-    switch (action) {
-    case Typing:
-        params.insert("action", HttpParameter("typing"));
-        break;
-    case UploadingPhoto:
-        params.insert("action", HttpParameter("upload_photo"));
-        break;
-    case RecordingVideo:
-        params.insert("action", HttpParameter("record_video"));
-        break;
-    case UploadingVideo:
-        params.insert("action", HttpParameter("upload_video"));
-        break;
-    case RecordingAudio:
-        params.insert("action", HttpParameter("record_audio"));
-        break;
-    case UploadingAudio:
-        params.insert("action", HttpParameter("upload_audio"));
-        break;
-    case UploadingDocument:
-        params.insert("action", HttpParameter("upload_document"));
-        break;
-    case FindingLocation:
-        params.insert("action", HttpParameter("find_location"));
-        break;
-    default:
-        return false;
-    }
+    RequestBuilder params;
+    params.add("chat_id", chatId);
+    params.add("action", actions[action]);
 
-    bool success = this->responseOk(m_net->request(ENDPOINT_SEND_CHAT_ACTION, params, Networking::POST));
+    // clients show an action for 5 seconds, a later one is useless
+    quint64 id = _enqueue(ENDPOINT_SEND_CHAT_ACTION, params, Networking::POST, Networking::Interactive, 5000);
+    m_pendingRequests.insert(id, [](QNetworkReply *reply) {
+                               if (reply && reply->error() != QNetworkReply::NoError)
+                                   qCWarning(CTelBot, "%s", qPrintable(QString("[%1] %2").arg(reply->error()).arg(reply->errorString())));
+                           });
+    return true;
+}
 
-    return success;
+bool Bot::answerCallbackQuery(const QString &callbackQueryId, const QString &text, bool showAlert, const QString &url, qint32 cacheTime)
+{
+    Api::AnswerCallbackQuery request(callbackQueryId);
+    request.text = text;
+    request.showAlert = showAlert;
+    request.url = url;
+    if (cacheTime > 0)
+        request.cacheTime = cacheTime;
+
+    call(request, [](QNetworkReply *reply) {
+        if (reply && reply->error() != QNetworkReply::NoError)
+            qCWarning(CTelBot, "%s", qPrintable(QString("[%1] %2").arg(reply->error()).arg(reply->errorString())));
+    }, Networking::Interactive);
+    return true;
 }
-*/
+
+bool Bot::answerInlineQuery(const QString &inlineQueryId, const QJsonArray &results, qint32 cacheTime, bool isPersonal, const QString &nextOffset)
+{
+    return answerInlineQuery(inlineQueryId, QJsonDocument(results).toJson(QJsonDocument::Compact), cacheTime, isPersonal, nextOffset);
+}
+
+bool Bot::answerInlineQuery(const QString &inlineQueryId, const QByteArray &resultsJson, qint32 cacheTime, bool isPersonal, const QString &nextOffset)
+{
+    RequestBuilder params;
+    params.add("inline_query_id", inlineQueryId);
+    params.add("results", resultsJson);
+    if (cacheTime >= 0)
+        params.add("cache_time", cacheTime);
+    if (isPersonal)
+        params.add("is_personal", true);
+    if (!nextOffset.isEmpty())
+        params.add("next_offset", nextOffset);
+
+    call(ENDPOINT_ANSWER_INLINE_QUERY, params, Networking::POST, [](QNetworkReply *reply) {
+        if (reply && reply->error() != QNetworkReply::NoError)
+            qCWarning(CTelBot, "%s", qPrintable(QString("[%1] %2").arg(reply->error()).arg(reply->errorString())));
+    }, Networking::Interactive);
+    return true;
+}
+
 /*
 UserProfilePhotos Bot::getUserProfilePhotos(quint32 userId, qint16 offset, qint8 limit)
 {
@@ -391,31 +705,48 @@ File Bot::getFile(const QString &fileId)
 }
 */
 
-bool Bot::_sendPayload(const ChatId &chatId, QFile *filePayload, ParameterList params, qint32 replyToMessageId, const GenericReply &replyMarkup, QString payloadField, QString endpoint)
+bool Bot::_sendPayload(const ChatId &chatId, QFile *filePayload, RequestBuilder params, qint32 replyToMessageId, const GenericReply &replyMarkup, const char *payloadField, const QString &endpoint)
 {
-    params.insert("chat_id", HttpParameter(chatId));
+    if (m_localMode && !filePayload->isOpen() && !filePayload->fileName().startsWith(':')) {
+        // the server reads the file itself, nothing but the path is sent
+        if (!filePayload->exists()) {
+            qCCritical(CTelBot, "Could not open file %s [does not exist]", qPrintable(filePayload->fileName()));
+            return false;
+        }
+        const QString uri = QUrl::fromLocalFile(QFileInfo(filePayload->fileName()).absoluteFilePath()).toString();
+        return _sendPayload(chatId, uri, params, replyToMessageId, replyMarkup, payloadField, endpoint);
+    }
 
-    QMimeDatabase db;
-    bool openedFile = false;
+    params.add("chat_id", chatId);
+
+    QString mimeType = filePayload->property(MIME_TYPE_PROPERTY).toString();
     if (!filePayload->isOpen()) {
-        if (!filePayload->open(QFile::ReadOnly)) {
-            qCCritical(CTelBot, "Could not open file %s [%s]", qPrintable(filePayload->fileName()), qPrintable(filePayload->errorString()));
+        // stream from disk while sending
+        if (!filePayload->exists()) {
+            qCCritical(CTelBot, "Could not open file %s [does not exist]", qPrintable(filePayload->fileName()));
             return false;
         }
-        openedFile = true;
+        if (mimeType.isEmpty())
+            mimeType = MimeDetector::mimeTypeForFile(filePayload->fileName());
+        params.addFilePath(payloadField, filePayload->fileName(), mimeType, filePayload->fileName());
+    } else {
+        QByteArray data = filePayload->readAll();
+        if (mimeType.isEmpty())
+            mimeType = MimeDetector::mimeTypeForData(filePayload->fileName(), data);
+        params.addFile(payloadField, data, mimeType, filePayload->fileName());
     }
-    QByteArray data = filePayload->readAll();
-    if (openedFile) filePayload->close();
-    params.insert(payloadField, HttpParameter(data, true, db.mimeTypeForData(data).name(), filePayload->fileName()));
 
-    if (replyToMessageId >= 0) params.insert("reply_to_message_id", HttpParameter(replyToMessageId));
-    if (replyMarkup.isValid()) params.insert("reply_markup", HttpParameter(replyMarkup.serialize()));
+    if (replyToMessageId >= 0) params.add("reply_to_message_id", replyToMessageId);
+    if (replyMarkup.isValid()) params.add("reply_markup", replyMarkup);
 
     //bool success = this->responseOk(m_net->request(endpoint, params, Networking::UPLOAD));
-    auto reply = m_net->asyncRequest(endpoint, params, Networking::UPLOAD);
-    if (!reply) return false;
-    _pendingReplies.insert(std::make_pair(reply,
-                                          [this](QNetworkReply *reply) {
+    const Networking::Priority priority = currentPriority();
+    quint64 id = _enqueue(endpoint, params, Networking::UPLOAD, priority, m_deadlines[priority]);
+    m_pendingRequests.insert(id, [this](QNetworkReply *reply) {
+                               if (!reply) {
+                                   qCWarning(CTelBot) << "_sendPayload dropped";
+                                   return;
+                               }
                                if (reply->error() != QNetworkReply::NoError) {
                                    qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2").arg(reply->error()).arg(reply->errorString())));
                                    return; // todo emit signal here?
@@ -425,24 +756,26 @@ bool Bot::_sendPayload(const ChatId &chatId, QFile *filePayload, ParameterList p
                                if (!success)
                                qCWarning(CTelBot) << "_sendPayload no success" << reply;
                                // emit getMe(ret); todo emit a signal here
-                           }
-                               ));
+                           });
     return true;
 }
 
 
-bool Bot::_sendPayload(const ChatId &chatId, const QString &textPayload, ParameterList &params, qint32 replyToMessageId, const GenericReply &replyMarkup, const QString &payloadField, const QString &endpoint)
+bool Bot::_sendPayload(const ChatId &chatId, const QString &textPayload, RequestBuilder &params, qint32 replyToMessageId, const GenericReply &replyMarkup, const char *payloadField, const QString &endpoint)
 {
-    params.insert("chat_id", HttpParameter(chatId));
-    params.insert(payloadField, HttpParameter(textPayload));
-    if (replyToMessageId >= 0) params.insert("reply_to_message_id", HttpParameter(replyToMessageId));
-    if (replyMarkup.isValid()) params.insert("reply_markup", HttpParameter(replyMarkup.serialize()));
+    params.add("chat_id", chatId);
+    params.add(payloadField, textPayload);
+    if (replyToMessageId >= 0) params.add("reply_to_message_id", replyToMessageId);
+    if (replyMarkup.isValid()) params.add("reply_markup", replyMarkup);
 
     //bool success = this->responseOk(m_net->request(endpoint, params, Networking::POST));
-    auto reply = m_net->asyncRequest(endpoint, params, Networking::POST);
-    if (!reply) return false;
-    _pendingReplies.insert(std::make_pair(reply,
-                                          [this](QNetworkReply *reply) {
+    const Networking::Priority priority = currentPriority();
+    quint64 id = _enqueue(endpoint, params, Networking::POST, priority, m_deadlines[priority]);
+    m_pendingRequests.insert(id, [this](QNetworkReply *reply) {
+                               if (!reply) {
+                                   qCWarning(CTelBot) << "_sendPayload dropped";
+                                   return;
+                               }
                                if (reply->error() != QNetworkReply::NoError) {
                                    qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2 %3").arg(reply->error()).arg(reply->errorString()).arg(reply->readAll().toStdString().c_str())));
                                    return; // todo emit signal here?
@@ -452,8 +785,84 @@ bool Bot::_sendPayload(const ChatId &chatId, const QString &textPayload, Paramet
                                if (!success)
                                qCWarning(CTelBot) << "_sendPayload no success" << reply;
                                // emit getMe(ret); todo emit a signal here
-                           }
-                               ));
+                           });
+    return true;
+}
+
+bool Bot::_asyncRequest(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method, std::function<void(QNetworkReply*)> fn, Networking::Priority priority)
+{
+    quint64 id = _enqueue(endpoint, encodedParams, method, priority, m_deadlines[priority]);
+    m_pendingRequests.insert(id, fn);
+    return true;
+}
+
+Networking::Priority Bot::currentPriority() const
+{
+    // requests sent by message handlers answer a user
+    return m_dispatching ? Networking::Interactive : Networking::Normal;
+}
+
+void Bot::setDeadline(Networking::Priority priority, qint64 msec)
+{
+    if (priority >= 0 && priority < Networking::PriorityCount)
+        m_deadlines[priority] = msec;
+}
+
+void Bot::setMaxInFlight(int max)
+{
+    if (!m_ioWorker) {
+        m_net->setMaxInFlight(max);
+        return;
+    }
+    IoCommand command;
+    command.maxInFlight = qMax(1, max);
+    m_ioWorker->post(command);
+}
+
+bool Bot::_sharedRequest(const QString &endpoint, const RequestBuilder &params, SharedReplyHandler fn)
+{
+    const QByteArray encoded = params.encoded();
+    QByteArray key = endpoint.toLatin1();
+    key += '?';
+    key += encoded;
+
+    if (m_resultCacheTtl) {
+        const CachedResult *cached = m_resultCache.object(key);
+        if (cached && m_clock.elapsed() - cached->at < m_resultCacheTtl) {
+            const QByteArray body = cached->body; // fn may insert and evict
+            fn(true, body);
+            return true;
+        }
+    }
+
+    // join an identical request that is still in flight
+    auto it = m_inFlight.find(key);
+    if (it != m_inFlight.end()) {
+        it.value().append(fn);
+        return true;
+    }
+
+    const Networking::Priority priority = currentPriority();
+    quint64 id = _enqueue(endpoint, encoded, Networking::GET, priority, m_deadlines[priority]);
+    m_inFlight[key].append(fn);
+    m_pendingRequests.insert(id, [this, key](QNetworkReply *reply) {
+                               const bool ok = reply && reply->error() == QNetworkReply::NoError;
+                               const QByteArray body = reply ? reply->readAll() : QByteArray();
+                               if (!reply) {
+                                   qCWarning(CTelBot) << "request dropped" << key;
+                               } else if (!ok) {
+                                   qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2 %3").arg(reply->error()).arg(reply->errorString()).arg(body.constData())));
+                               } else if (m_resultCacheTtl && responseOk(body)) {
+                                   // least recently used entries are evicted beyond ResultCacheSize
+                                   CachedResult *cached = new CachedResult;
+                                   cached->body = body;
+                                   cached->at = m_clock.elapsed();
+                                   m_resultCache.insert(key, cached);
+                               }
+                               const QVector<SharedReplyHandler> waiting = m_inFlight.take(key);
+                               for (int i = 0; i < waiting.size(); ++i)
+                                   waiting[i](ok, body);
+                           });
     return true;
 }
 
@@ -519,10 +928,10 @@ QList<Update> Bot::getUpdates(quint32 timeout, quint32 limit, quint32 offset)
 */
 void Bot::internalGetUpdates()
 {
-    ParameterList params;
-    params.insert("offset", HttpParameter((int)m_updateOffset));
-    params.insert("limit", HttpParameter(50));
-    params.insert("timeout", HttpParameter(m_pollingTimeout));
+    RequestBuilder params;
+    params.add("offset", m_updateOffset);
+    params.add("limit", 50);
+    params.add("timeout", m_pollingTimeout);
     auto reply = m_net->asyncRequest(ENDPOINT_GET_UPDATES, params, Networking::GET);
     if (!reply) {
         qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "request failed";
@@ -530,36 +939,28 @@ void Bot::internalGetUpdates()
             m_internalUpdateTimer->start(m_updateInterval);
         return;
     }
+    // hand out updates while the response is still being received
+    m_updateParser.reset();
+    m_pollBatch = 0;
+    bool firstBytes = true;
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply, firstBytes]() mutable {
+        if (firstBytes) {
+            firstBytes = false;
+            Tracer *tracer = m_net->tracer();
+            if (tracer->isEnabled())
+                tracer->instant("first bytes", "poll", tracer->now(), 0);
+        }
+        m_updateParser.feed(reply, [this](const QJsonObject &obj) { processUpdate(obj); });
+    });
     _pendingReplies.insert(std::make_pair(reply,
                                           [this](QNetworkReply *reply) {
+                               m_updateParser.feed(reply, [this](const QJsonObject &obj) { processUpdate(obj); });
                                if (reply->error() != QNetworkReply::NoError) {
-                                   qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2 %3").arg(reply->error()).arg(reply->errorString()).arg(reply->readAll().toStdString().c_str())));
-                                   if (m_internalUpdateTimer)
-                                       m_internalUpdateTimer->start(m_updateInterval);
-                                   return;
-                               }
-                               QByteArray arr = reply->readAll();
-                               QJsonArray json = this->jsonArrayFromByteArray(arr);
-                               //if (json.count())
-                               // qCDebug(CTelBot) << __PRETTY_FUNCTION__ << json;
-                               foreach (QJsonValue value, json) {
-                                   if (value.isObject()) {
-                                       const QJsonObject &obj = value.toObject();
-                                       uint64_t id = 0;
-                                       if (obj.contains("update_id")) {
-                                           id = obj["update_id"].toDouble();
-                                           if (id >= m_updateOffset)
-                                            m_updateOffset = id + 1;
-                                       }
-
-                                       if (obj.contains("message")||obj.contains("channel_post")) {
-                                           Update u(obj);
-                                           emit message(id, u.message);
-                                       } else
-                                        qCDebug(CTelBot) << __PRETTY_FUNCTION__ << "ignored obj:" << obj;
-                                   } else
-                                    qCDebug(CTelBot) << __PRETTY_FUNCTION__ << "ignored:" << value;
+                                   qCCritical(CTelBot, "%s", qPrintable(QString("[%1] %2 %3").arg(reply->error()).arg(reply->errorString()).arg(m_updateParser.pendingData().constData())));
+                               } else if (!m_updateParser.isOk()) {
+                                   qCWarning(CTelBot, "Result is not Ok");
                                }
+                               m_net->metrics()->recordPollBatch(m_pollBatch);
                                if (m_internalUpdateTimer)
                                    m_internalUpdateTimer->start(m_updateInterval);
                            }
@@ -577,3 +978,50 @@ void Bot::internalGetUpdates()
     m_internalUpdateTimer->start(m_updateInterval);
     */
 }
+
+void Bot::processUpdate(const QJsonObject &obj)
+{
+    uint64_t id = 0;
+    if (obj.contains("update_id")) {
+        id = obj["update_id"].toDouble();
+        if (id >= m_updateOffset)
+            m_updateOffset = id + 1;
+    }
+
+    ++m_pollBatch;
+
+    const bool isMessage = obj.contains("message") || obj.contains("channel_post");
+    const bool isCallbackQuery = obj.contains("callback_query");
+    if (!isMessage && !isCallbackQuery && !obj.contains("inline_query")) {
+        qCDebug(CTelBot) << __PRETTY_FUNCTION__ << "ignored obj:" << obj;
+        return;
+    }
+
+    Tracer *tracer = m_net->tracer();
+    const qint64 received = tracer->isEnabled() ? tracer->now() : 0;
+    Update u(obj);
+    if (isMessage && u.message.date.isValid()) {
+        m_net->metrics()->recordUpdateLag(QDateTime::currentMSecsSinceEpoch() - u.message.date.toMSecsSinceEpoch());
+        // message date has second resolution only
+        if (tracer->isEnabled())
+            tracer->complete("telegram", "update", u.message.date.toMSecsSinceEpoch() * 1000, received, id);
+    }
+    if (tracer->isEnabled())
+        tracer->complete("decode", "update", received, tracer->now(), id);
+
+    // requests sent by the handlers are attributed to this update
+    const quint64 previousUpdate = tracer->currentUpdate();
+    tracer->setCurrentUpdate(id);
+    {
+        Tracer::Span span(tracer, "dispatch", "update", id);
+        ++m_dispatching;
+        if (isMessage)
+            emit message(id, u.message);
+        else if (isCallbackQuery)
+            emit callbackQuery(id, u.callbackQuery);
+        else
+            emit inlineQuery(id, u.inlineQuery);
+        --m_dispatching;
+    }
+    tracer->setCurrentUpdate(previousUpdate);
+}
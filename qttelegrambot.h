@@ -2,6 +2,7 @@
 #define QTTELEGRAMBOT_H
 
 #include <map>
+#include <memory>
 #include <functional>
 #include <QObject>
 #include <QLoggingCategory>
@@ -17,8 +18,26 @@
 #include <QFile>
 #include <QMimeDatabase>
 #include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QCache>
+#include <QVector>
 
 #include "networking.h"
+#include "apimethods.h"
+#include "broadcast.h"
+#include "updatestreamparser.h"
+#include "router.h"
+#include "sessionstore.h"
+#include "conversation.h"
+#include "chatdirectory.h"
+#include "interner.h"
+#include "mimedetector.h"
+#include "mappedfile.h"
+#include "ioworker.h"
+#include "bufferedreply.h"
+#include "callbackdata.h"
 #include "types/chat.h"
 #include "types/update.h"
 #include "types/user.h"
@@ -28,6 +47,8 @@
 #include "types/reply/replykeyboardmarkup.h"
 #include "types/reply/replykeyboardhide.h"
 #include "types/reply/forcereply.h"
+#include "types/reply/encodedreply.h"
+#include "types/reply/inlinekeyboardmarkup.h"
 
 namespace Telegram {
 Q_DECLARE_LOGGING_CATEGORY(CTelBot)
@@ -47,8 +68,55 @@ public:
      * @param parent
      */
     explicit Bot(const QString &token, bool updates = false, quint32 updateInterval = 1000, quint32 pollingTimeout = 0, QObject *parent = 0);
+
+    /**
+     * Where networking, TLS and update parsing run.
+     * SameThread: on the thread of the bot.
+     * IoThread: on an internal thread, handlers and callbacks still run on the thread of the bot.
+     */
+    enum IoMode { SameThread, IoThread };
+
+    /**
+     * @param ioMode - see IoMode
+     * @see Bot(const QString &, bool, quint32, quint32, QObject *)
+     */
+    Bot(const QString &token, IoMode ioMode, bool updates = false, quint32 updateInterval = 1000, quint32 pollingTimeout = 0, QObject *parent = 0);
     ~Bot();
 
+    typedef std::function<void(std::function<void()> task)> Executor;
+
+    /**
+     * In IoThread mode received updates are handed to executor instead of being processed right
+     * away, e.g. to defer or batch them behind other work of a busy event loop. The task has to
+     * run on the thread of the bot, as do all Bot methods.
+     */
+    void setHandlerExecutor(Executor executor);
+
+    /**
+     * Opens connections to the api host and requests getMe, in parallel with the first poll.
+     * Polling starts from the event loop, so warmUp and setTlsSessionCache called right after
+     * construction apply to the first poll already.
+     * @see Networking::warmUp
+     */
+    void warmUp(int connections = 2);
+
+    /**
+     * @see Networking::setTlsSessionCache
+     */
+    void setTlsSessionCache(const QString &fileName);
+
+    /**
+     * @see Networking::setLocalServer
+     */
+    void setLocalServer(const QString &address);
+
+    /**
+     * For a Bot API server started with --local on this machine: files passed to the send methods
+     * unopened are sent as file:// uri for the server to read from disk instead of being uploaded,
+     * and downloadFile maps the absolute paths getFile returns then. Off by default.
+     */
+    void setLocalMode(bool enabled) { m_localMode = enabled; }
+
     enum ChatAction { Typing, UploadingPhoto, RecordingVideo, UploadingVideo, RecordingAudio, UploadingAudio, UploadingDocument, FindingLocation };
 
     /**
@@ -57,8 +125,48 @@ public:
      * @see https://core.telegram.org/bots/api#getme
      */
     User getMe();
+    typedef std::function<void(bool ok, const User &user)> UserCallback;
+    typedef std::function<void(bool ok, const Chat &chat)> ChatCallback;
+
     bool asyncGetMe(); // emits signal getMe async
+    bool asyncGetMe(UserCallback fn); // emits signal getMe and calls fn
     bool asyncGetChat(const QVariant &chatId); // emits signal gotObject with Chat object
+    bool asyncGetChat(const ChatId &chatId, ChatCallback fn); // emits gotObject and gotChat and calls fn
+
+    typedef std::function<void(bool ok, const File &file)> FileCallback;
+    typedef std::function<void(bool ok, const UserProfilePhotos &photos)> UserProfilePhotosCallback;
+
+    /**
+     * Async version of getFile.
+     * @see https://core.telegram.org/bots/api#getfile
+     */
+    bool asyncGetFile(const QString &fileId, FileCallback fn);
+
+    typedef std::function<void(bool ok, const std::shared_ptr<MappedFile> &file)> DownloadCallback;
+
+    /**
+     * Fetches the content of a file returned by getFile. In local mode the absolute paths of a
+     * --local server are memory mapped instead of being read, without it they fail. Others are
+     * downloaded. fn is always called from the event loop, failures included; file->data() stays
+     * valid as long as file is referenced, file is null on failure.
+     * @see setLocalMode
+     * @see File::isLocal
+     */
+    bool downloadFile(const File &file, DownloadCallback fn);
+
+    /**
+     * Async version of getUserProfilePhotos.
+     * @see https://core.telegram.org/bots/api#getuserprofilephotos
+     */
+    bool asyncGetUserProfilePhotos(qint32 userId, UserProfilePhotosCallback fn, qint16 offset = -1, qint8 limit = -1);
+
+    /**
+     * Identical getMe, getChat, getFile and getUserProfilePhotos calls issued while one of them is
+     * in flight share its reply. Additionally successful results can be kept for a short time, the
+     * ResultCacheSize most recently stored ones.
+     * @param msec - how long results are reused, 0 disables the cache (default)
+     */
+    void setResultCacheTtl(quint32 msec);
 
     /**
      * Send text message.
@@ -89,7 +197,8 @@ public:
     /**
      * Send a photo
      * @param chatId - Unique identifier for the message recipient or @channelname
-     * @param file - A file to send
+     * @param file - A file to send. A file that is not open is streamed from disk. Its content type is
+     *               detected unless set as dynamic property MIME_TYPE_PROPERTY, same for all send methods
      * @param caption - Photo caption
      * @param replyToMessageId - If the message is a reply, ID of the original message
      * @param replyMarkup - Additional interface options
@@ -246,12 +355,46 @@ public:
 
     /**
      * Use this method when you need to tell the user that something is happening on the bot's side.
+     * Sent in the interactive lane and dropped if it can't be sent within 5 seconds.
      * @param chatId - Unique identifier for the message recipient or @channelname
      * @param action - Type of action to broadcast
      * @return success
      * @see https://core.telegram.org/bots/api#sendchataction
      */
-    bool sendChatAction(QVariant chatId, ChatAction action);
+    bool sendChatAction(const ChatId &chatId, ChatAction action);
+
+    /**
+     * Use this method to send answers to callback queries sent from inline keyboards.
+     * The client shows a progress indicator until the answer arrives, so it is sent in the interactive lane.
+     * @param callbackQueryId - Unique identifier for the query to be answered
+     * @param text - Optional. Notification shown to the user, 0-200 characters
+     * @param showAlert - Optional. Show an alert instead of a notification at the top of the chat screen
+     * @param url - Optional. URL that will be opened by the user's client
+     * @param cacheTime - Optional. Seconds the result may be cached on the client
+     * @return success
+     * @see https://core.telegram.org/bots/api#answercallbackquery
+     */
+    bool answerCallbackQuery(const QString &callbackQueryId, const QString &text = QString(), bool showAlert = false,
+                             const QString &url = QString(), qint32 cacheTime = 0);
+
+    /**
+     * Use this method to send answers to an inline query. No more than 50 results per query are allowed.
+     * @param inlineQueryId - Unique identifier for the answered query
+     * @param results - Array of InlineQueryResult objects
+     * @param cacheTime - seconds the result may be cached on the server, -1 for the server default of 300
+     * @param isPersonal - results may only be cached on the server for the user that sent the query
+     * @param nextOffset - offset the client sends in its next query for more results, empty if there are no more
+     * @return success
+     * @see https://core.telegram.org/bots/api#answerinlinequery
+     */
+    bool answerInlineQuery(const QString &inlineQueryId, const QJsonArray &results, qint32 cacheTime = -1,
+                           bool isPersonal = false, const QString &nextOffset = QString());
+
+    /**
+     * Same as above with results already serialized to compact json, e.g. kept in a cache.
+     */
+    bool answerInlineQuery(const QString &inlineQueryId, const QByteArray &resultsJson, qint32 cacheTime = -1,
+                           bool isPersonal = false, const QString &nextOffset = QString());
 
     /**
      * Use this method to get a list of profile pictures for a user.
@@ -290,31 +433,135 @@ public:
      */
     File getFile(const QString &fileId);
 
+    /**
+     * Send the same text message to many chats.
+     * The request body is encoded once and sent in rate limited batches, see Broadcast.
+     * @param chatIds - recipients
+     * @param text - Text of the message to be sent
+     * @param markdown - Use markdown in message display
+     * @param disableWebPagePreview - Disables link previews for links in this message
+     * @param replyMarkup - Additional interface options
+     * @return running Broadcast object, owned by the bot and deleted after it signaled finished.
+     * Connect to its signals for progress and failures, keep it in a QPointer.
+     */
+    Broadcast *broadcastMessage(const QVector<ChatId> &chatIds, const QString &text, bool markdown = false, bool disableWebPagePreview = false, const GenericReply &replyMarkup = GenericReply());
+
+    /**
+     * Send the same payload to many chats.
+     * @param chatIds - recipients
+     * @param endpoint - API endpoint, e.g. ENDPOINT_SEND_PHOTO
+     * @param payload - parameters shared by all recipients, without chat_id. Uploads are not supported.
+     * @return running Broadcast object, owned by the bot and deleted after it signaled finished.
+     */
+    Broadcast *broadcast(const QVector<ChatId> &chatIds, const QString &endpoint, const RequestBuilder &payload);
+
+    /**
+     * Sends a request to any endpoint in the lane of priority.
+     * @param fn - gets the reply, or 0 if the request was dropped or cancelled before it was sent
+     * @return request id for cancel()
+     */
+    quint64 call(const QString &endpoint, const RequestBuilder &params, Networking::Method method, std::function<void(QNetworkReply*)> fn, Networking::Priority priority = Networking::Normal);
+
+    /**
+     * Sends a typed request, e.g. Api::SendMessage.
+     * @return request id for cancel()
+     */
+    template <typename Method>
+    quint64 call(const Method &request, std::function<void(QNetworkReply*)> fn, Networking::Priority priority = Networking::Normal) {
+        return call(QLatin1String(Method::endpoint()), Api::encode(request), Method::method, fn, priority);
+    }
+
+    /**
+     * Cancels a request sent by call(). Its callback still runs, with a null or aborted reply.
+     */
+    void cancel(quint64 id);
+
+    /**
+     * Request, error and polling statistics. Use MetricsServer or Metrics::prometheus() to export them.
+     */
+    Metrics *metrics() const;
+
+    /**
+     * Latency tracing of updates, handlers and the requests they send. Disabled by default,
+     * enable with tracer()->setEnabled(true) and dump with Tracer::writeChromeTrace().
+     */
+    Tracer *tracer() const;
+
+    /**
+     * Requests sent from message handlers go to the Interactive lane, other sends and lookups to
+     * Normal, broadcasts to Bulk.
+     * @param msec - requests of priority not sent within msec are dropped, 0 disables (default)
+     */
+    void setDeadline(Networking::Priority priority, qint64 msec);
+
+    /**
+     * @see Networking::setMaxInFlight
+     */
+    void setMaxInFlight(int max);
+
 private:
+    friend class Broadcast;
     Networking *m_net;
+    QThread *m_ioThread;
+    IoWorker *m_ioWorker; // only in IoThread mode, m_net then lives on m_ioThread
+    quint64 m_nextTicket;
+    Executor m_executor;
+    bool m_localMode;
+
+    // schedules on m_net directly or through the I/O thread, returns the id passed to requestCompleted
+    quint64 _enqueue(const QString &endpoint, const RequestBuilder &params, Networking::Method method, Networking::Priority priority, qint64 deadline);
+    quint64 _enqueue(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method, Networking::Priority priority, qint64 deadline);
+
+    bool _asyncRequest(const QString &endpoint, const QByteArray &encodedParams, Networking::Method method, std::function<void(QNetworkReply*)> fn, Networking::Priority priority = Networking::Normal);
+    Networking::Priority currentPriority() const;
+
+    // single-flight GET for idempotent endpoints, body is read once and handed to all callers
+    typedef std::function<void(bool ok, const QByteArray &body)> SharedReplyHandler;
+    bool _sharedRequest(const QString &endpoint, const RequestBuilder &params, SharedReplyHandler fn);
 
-    bool _sendPayload(const ChatId &chatId, QFile *filePayload, ParameterList params, qint32 replyToMessageId, const GenericReply &replyMarkup, QString payloadField, QString endpoint);
-    bool _sendPayload(const ChatId &chatId, const QString &textPayload, ParameterList &params, qint32 replyToMessageId, const GenericReply &replyMarkup, const QString &payloadField, const QString &endpoint);
+    bool _sendPayload(const ChatId &chatId, QFile *filePayload, RequestBuilder params, qint32 replyToMessageId, const GenericReply &replyMarkup, const char *payloadField, const QString &endpoint);
+    bool _sendPayload(const ChatId &chatId, const QString &textPayload, RequestBuilder &params, qint32 replyToMessageId, const GenericReply &replyMarkup, const char *payloadField, const QString &endpoint);
 
     QJsonObject jsonObjectFromByteArray(QByteArray json);
     QJsonArray jsonArrayFromByteArray(QByteArray json);
     bool responseOk(QByteArray json);
 
     void internalGetUpdates();
+    void processUpdate(const QJsonObject &obj);
+    UpdateStreamParser m_updateParser;
     QTimer *m_internalUpdateTimer;
     quint32 m_updateInterval;
     uint64_t m_updateOffset;
     quint32 m_pollingTimeout;
+    int m_pollBatch; // updates received by the running getUpdates call
     //typedef void (*processReplyFunc)(QNetworkReply*);
     std::map<QNetworkReply*, std::function<void(QNetworkReply*)>> _pendingReplies;
+    QHash<quint64, std::function<void(QNetworkReply*)> > m_pendingRequests; // scheduled requests by id, reply is 0 if dropped
+    qint64 m_deadlines[Networking::PriorityCount];
+    int m_dispatching; // nesting depth of message handlers
+
+    struct CachedResult {
+        QByteArray body;
+        qint64 at;
+    };
+    QHash<QByteArray, QVector<SharedReplyHandler> > m_inFlight;
+    enum { ResultCacheSize = 1024 };
+    QCache<QByteArray, CachedResult> m_resultCache;
+    quint32 m_resultCacheTtl;
+    QElapsedTimer m_clock;
 
 private slots:
     void requestFinished(QNetworkReply *reply);
+    void requestCompleted(quint64 id, QNetworkReply *reply);
+    void drainIoEvents();
 
 signals:
     void getMe(User user);
     void gotObject(QJsonObject obj);
+    void gotChat(Chat chat);
     void message(uint64_t update_id, Message message);
+    void callbackQuery(uint64_t update_id, CallbackQuery query);
+    void inlineQuery(uint64_t update_id, InlineQuery query);
 };
 
 }
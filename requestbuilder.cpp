@@ -0,0 +1,467 @@
+#include <cstring>
+#include <ctime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QHttpMultiPart>
+#include "requestbuilder.h"
+#include "networking.h"
+
+using namespace Telegram;
+
+namespace {
+
+// characters that are not escaped in application/x-www-form-urlencoded: ALPHA / DIGIT / "*" / "-" / "." / "_"
+// space is written as '+'
+const bool s_plain[256] = {
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0x00
+    0,0,0,0,0,0,0,0, 0,0,1,0,0,1,1,0, 1,1,1,1,1,1,1,1, 1,1,0,0,0,0,0,0, // 0x20 '*' '-' '.' 0-9
+    0,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,0,0,0,0,1, // 0x40 A-Z '_'
+    0,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,0,0,0,0,0, // 0x60 a-z
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0x80
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0
+};
+
+const char s_hex[] = "0123456789ABCDEF";
+
+// inverse of percentEncode, fromPercentEncoding alone would keep '+' for space
+QByteArray formDecode(QByteArray value)
+{
+    return QByteArray::fromPercentEncoding(value.replace('+', ' '));
+}
+
+inline int plainRun(const uchar *p, const uchar *end)
+{
+    const uchar *start = p;
+    while (p != end && s_plain[*p])
+        ++p;
+    return int(p - start);
+}
+
+}
+
+int RequestBuilder::encodedLength(const char *data, int length)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + length;
+    int ret = 0;
+    while (p != end) {
+        int run = plainRun(p, end);
+        ret += run;
+        p += run;
+        if (p != end) {
+            ret += (*p == ' ') ? 1 : 3;
+            ++p;
+        }
+    }
+    return ret;
+}
+
+char *RequestBuilder::percentEncode(const char *data, int length, char *out)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + length;
+    while (p != end) {
+        // copy runs of plain characters in one go, they are the common case for text and ids
+        int run = plainRun(p, end);
+        memcpy(out, p, run);
+        out += run;
+        p += run;
+        if (p != end) {
+            if (*p == ' ') {
+                *out++ = '+';
+            } else {
+                *out++ = '%';
+                *out++ = s_hex[*p >> 4];
+                *out++ = s_hex[*p & 0xf];
+            }
+            ++p;
+        }
+    }
+    return out;
+}
+
+QByteArray RequestBuilder::percentEncode(const QByteArray &value)
+{
+    QByteArray ret(encodedLength(value.constData(), value.size()), Qt::Uninitialized);
+    percentEncode(value.constData(), value.size(), ret.data());
+    return ret;
+}
+
+RequestBuilder::RequestBuilder(const ParameterList &list)
+{
+    ParameterList::const_iterator i = list.begin();
+    while (i != list.end()) {
+        const HttpParameter &param = i.value();
+        QByteArray key = i.key().toUtf8();
+        Field::Kind kind = param.isFile ? Field::File : (param.isEncoded ? Field::Encoded : Field::Text);
+        Field &f = addField(kind, key.constData(), key.size());
+        if (param.isFile) {
+            QByteArray filename = param.filename.toUtf8();
+            QByteArray mime = param.mimeType.toUtf8();
+            f.value = append(filename.constData(), filename.size());
+            f.valueLength = filename.size();
+            f.mime = append(mime.constData(), mime.size());
+            f.mimeLength = mime.size();
+            f.payload = param.value;
+        } else if (param.isEncoded) {
+            f.payload = param.value;
+        } else {
+            f.value = append(param.value.constData(), param.value.size());
+            f.valueLength = param.value.size();
+        }
+        ++i;
+    }
+}
+
+RequestBuilder::Field &RequestBuilder::addField(Field::Kind kind, const char *key, int keyLength)
+{
+    m_fields.append(Field());
+    Field &f = m_fields[m_fields.size() - 1];
+    f.kind = kind;
+    f.key = append(key, keyLength);
+    f.keyLength = keyLength;
+    return f;
+}
+
+int RequestBuilder::append(const char *data, int length)
+{
+    int offset = m_data.size();
+    if (m_data.capacity() < offset + length)
+        m_data.reserve(qMax(128, 2 * (offset + length)));
+    m_data.append(data, length);
+    return offset;
+}
+
+RequestBuilder &RequestBuilder::add(const char *key, const QByteArray &value)
+{
+    Field &f = addField(Field::Text, key, int(strlen(key)));
+    f.value = append(value.constData(), value.size());
+    f.valueLength = value.size();
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::add(const char *key, const QString &value)
+{
+    return add(key, value.toUtf8());
+}
+
+RequestBuilder &RequestBuilder::add(const char *key, const char *value)
+{
+    Field &f = addField(Field::Text, key, int(strlen(key)));
+    int length = int(strlen(value));
+    f.value = append(value, length);
+    f.valueLength = length;
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::add(const char *key, const ChatId &value)
+{
+    if (!value.isNumeric())
+        return add(key, value.toString());
+
+    // the decimal representation only consists of plain characters
+    char decimal[ChatId::DecimalSize];
+    const int length = value.decimal(decimal);
+    Field &f = addField(Field::Text, key, int(strlen(key)));
+    f.value = append(decimal, length);
+    f.valueLength = length;
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::add(const char *key, double value)
+{
+    return add(key, QByteArray::number(value, 'g', 10));
+}
+
+RequestBuilder &RequestBuilder::addBool(const char *key, bool value)
+{
+    return add(key, value ? "true" : "false");
+}
+
+RequestBuilder &RequestBuilder::addSigned(const char *key, qint64 value)
+{
+    if (value >= 0)
+        return addUnsigned(key, quint64(value));
+
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    quint64 v = quint64(0) - quint64(value);
+    do {
+        *--p = char('0' + v % 10);
+        v /= 10;
+    } while (v);
+    *--p = '-';
+
+    Field &f = addField(Field::Text, key, int(strlen(key)));
+    f.value = append(p, int(end - p));
+    f.valueLength = int(end - p);
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::addUnsigned(const char *key, quint64 value)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = end;
+    do {
+        *--p = char('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    Field &f = addField(Field::Text, key, int(strlen(key)));
+    f.value = append(p, int(end - p));
+    f.valueLength = int(end - p);
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::add(const char *key, const GenericReply &reply)
+{
+    Field &f = addField(Field::Markup, key, int(strlen(key)));
+    f.payload = reply.formEncoded();
+    f.json = reply.json();
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::addEncoded(const char *key, const QByteArray &value)
+{
+    Field &f = addField(Field::Encoded, key, int(strlen(key)));
+    f.payload = value;
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::addFile(const char *key, const QByteArray &data, const QString &mimeType, const QString &filename)
+{
+    QByteArray name = filename.toUtf8();
+    QByteArray mime = mimeType.toUtf8();
+    Field &f = addField(Field::File, key, int(strlen(key)));
+    f.value = append(name.constData(), name.size());
+    f.valueLength = name.size();
+    f.mime = append(mime.constData(), mime.size());
+    f.mimeLength = mime.size();
+    f.payload = data;
+    return *this;
+}
+
+RequestBuilder &RequestBuilder::addFilePath(const char *key, const QString &path, const QString &mimeType, const QString &filename)
+{
+    addFile(key, path.toUtf8(), mimeType, filename);
+    m_fields[m_fields.size() - 1].kind = Field::FilePath;
+    return *this;
+}
+
+bool RequestBuilder::hasFiles() const
+{
+    for (int i = 0; i < m_fields.size(); ++i) {
+        if (m_fields[i].kind == Field::File || m_fields[i].kind == Field::FilePath)
+            return true;
+    }
+    return false;
+}
+
+bool RequestBuilder::hasStreamedFiles() const
+{
+    for (int i = 0; i < m_fields.size(); ++i) {
+        if (m_fields[i].kind == Field::FilePath)
+            return true;
+    }
+    return false;
+}
+
+qint64 RequestBuilder::contentSize() const
+{
+    qint64 size = m_data.size();
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        if (f.kind == Field::FilePath)
+            size += QFileInfo(QString::fromUtf8(f.payload)).size();
+        else if (f.kind == Field::Markup)
+            size += f.json.size();
+        else
+            size += f.payload.size();
+    }
+    return size;
+}
+
+RequestBuilder RequestBuilder::withFilesLoaded() const
+{
+    RequestBuilder ret(*this);
+    for (int i = 0; i < ret.m_fields.size(); ++i) {
+        Field &f = ret.m_fields[i];
+        if (f.kind != Field::FilePath)
+            continue;
+        QFile file(QString::fromUtf8(f.payload));
+        if (!file.open(QIODevice::ReadOnly))
+            qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "could not open" << file.fileName() << file.errorString();
+        f.kind = Field::File;
+        f.payload = file.readAll();
+    }
+    return ret;
+}
+
+QByteArray RequestBuilder::encoded() const
+{
+    // first pass: exact size, second pass: escape directly into the output
+    int size = 0;
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        if (f.kind == Field::File || f.kind == Field::FilePath) {
+            qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "files can't be url encoded";
+            continue;
+        }
+        if (size) ++size; // '&'
+        size += f.keyLength + 1;
+        size += (f.kind == Field::Text) ? encodedLength(m_data.constData() + f.value, f.valueLength) : f.payload.size();
+    }
+
+    QByteArray ret(size, Qt::Uninitialized);
+    char *out = ret.data();
+    const char *data = m_data.constData();
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        if (f.kind == Field::File || f.kind == Field::FilePath)
+            continue;
+        if (out != ret.constData())
+            *out++ = '&';
+        memcpy(out, data + f.key, f.keyLength);
+        out += f.keyLength;
+        *out++ = '=';
+        if (f.kind == Field::Text) {
+            out = percentEncode(data + f.value, f.valueLength, out);
+        } else {
+            memcpy(out, f.payload.constData(), f.payload.size());
+            out += f.payload.size();
+        }
+    }
+
+    return ret;
+}
+
+QByteArray RequestBuilder::multipart(const QByteArray &boundary) const
+{
+    static const char disposition[] = "Content-Disposition: form-data; name=\"";
+    static const char filenameAttr[] = "\"; filename=\"";
+    static const char contentType[] = "Content-Type: ";
+
+    // fallback for callers that need the body in one piece
+    if (hasStreamedFiles())
+        return withFilesLoaded().multipart(boundary);
+
+    int size = boundary.size() + 4; // closing "--boundary--"
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        size += 2 + boundary.size() + 2;
+        size += int(sizeof(disposition)) - 1 + f.keyLength + 3;
+        if (f.kind == Field::File)
+            size += int(sizeof(filenameAttr)) - 1 + f.valueLength + int(sizeof(contentType)) - 1 + f.mimeLength + 2;
+        size += 2;
+        if (f.kind == Field::Text)
+            size += f.valueLength;
+        else if (f.kind == Field::Markup)
+            size += f.json.size();
+        else
+            size += f.payload.size();
+        size += 2;
+    }
+
+    QByteArray result;
+    result.reserve(size);
+    const char *data = m_data.constData();
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        result.append("--").append(boundary).append("\r\n");
+        result.append(disposition, int(sizeof(disposition)) - 1);
+        result.append(data + f.key, f.keyLength);
+        if (f.kind == Field::File) {
+            result.append(filenameAttr, int(sizeof(filenameAttr)) - 1);
+            result.append(data + f.value, f.valueLength);
+        }
+        result.append("\"\r\n");
+        if (f.kind == Field::File) {
+            result.append(contentType, int(sizeof(contentType)) - 1);
+            result.append(data + f.mime, f.mimeLength);
+            result.append("\r\n");
+        }
+        result.append("\r\n");
+        if (f.kind == Field::Text)
+            result.append(data + f.value, f.valueLength);
+        else if (f.kind == Field::Markup)
+            result.append(f.json);
+        else if (f.kind == Field::Encoded)
+            result.append(formDecode(f.payload));
+        else
+            result.append(f.payload);
+        result.append("\r\n");
+    }
+    result.append("--").append(boundary).append("--");
+
+    return result;
+}
+
+QByteArray RequestBuilder::multipartBoundary() const
+{
+    // Generates a boundary that is not existent in the data
+    static const char chars[] = "qwertyuiopasdfghjklzxcvbnmQWERTYUIOPASDFGHJKLZXCVBNM1234567890";
+    static const size_t charsLen = sizeof(chars) - 1;
+    QByteArray result;
+
+    srand((unsigned int) time(NULL));
+    // streamed files are only read when the body is built, a boundary of 32 random characters
+    // won't occur in them by chance
+    if (hasStreamedFiles()) {
+        for (int j = 0; j < 32; ++j)
+            result.append(chars[rand() % charsLen]);
+    }
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        if (f.kind == Field::File) {
+            while (result.isEmpty() || f.payload.contains(result)) {
+                for (int j = 0; j < 4; ++j)
+                    result.append(chars[rand() % charsLen]);
+            }
+        }
+    }
+    if (result.isEmpty())
+        result = "QtTelegramBot";
+
+    return result;
+}
+
+QHttpMultiPart *RequestBuilder::httpMultiPart() const
+{
+    QHttpMultiPart *multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+    const char *data = m_data.constData();
+    for (int i = 0; i < m_fields.size(); ++i) {
+        const Field &f = m_fields[i];
+        QHttpPart part;
+        QByteArray disposition = "form-data; name=\"" + QByteArray(data + f.key, f.keyLength) + '"';
+        if (f.kind == Field::File || f.kind == Field::FilePath) {
+            disposition += "; filename=\"" + QByteArray(data + f.value, f.valueLength) + '"';
+            part.setRawHeader("Content-Type", QByteArray(data + f.mime, f.mimeLength));
+        }
+        part.setRawHeader("Content-Disposition", disposition);
+
+        if (f.kind == Field::Text) {
+            part.setBody(QByteArray(data + f.value, f.valueLength));
+        } else if (f.kind == Field::Markup) {
+            part.setBody(f.json);
+        } else if (f.kind == Field::Encoded) {
+            part.setBody(formDecode(f.payload));
+        } else if (f.kind == Field::File) {
+            part.setBody(f.payload);
+        } else {
+            QFile *file = new QFile(QString::fromUtf8(f.payload), multiPart);
+            if (!file->open(QIODevice::ReadOnly)) {
+                qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "could not open" << file->fileName() << file->errorString();
+                delete multiPart;
+                return 0;
+            }
+            part.setBodyDevice(file);
+        }
+        multiPart->append(part);
+    }
+    return multiPart;
+}
@@ -0,0 +1,133 @@
+#ifndef REQUESTBUILDER_H
+#define REQUESTBUILDER_H
+
+#include <type_traits>
+#include <QByteArray>
+#include <QString>
+#include <QMap>
+#include <QVarLengthArray>
+
+class QHttpMultiPart;
+
+#include "types/chat.h"
+#include "types/reply/genericreply.h"
+
+namespace Telegram {
+
+class HttpParameter;
+typedef QMap<QString, HttpParameter> ParameterList;
+
+/**
+ * Flat, allocation light builder for request parameters.
+ * Keys and values are copied into one internal buffer, the field table lives in an inline buffer
+ * for the usual handful of parameters. encoded() and multipart() write the request body into one
+ * pre-sized output buffer. Values are percent encoded, keys are expected to be plain ascii.
+ */
+class RequestBuilder
+{
+public:
+    RequestBuilder() {}
+    RequestBuilder(const ParameterList &list); // compatibility with the QMap based ParameterList
+
+    RequestBuilder &add(const char *key, const QString &value);
+    RequestBuilder &add(const char *key, const QByteArray &value); // utf8
+    RequestBuilder &add(const char *key, const char *value);
+    RequestBuilder &add(const char *key, const ChatId &value);
+    RequestBuilder &add(const char *key, double value);
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, RequestBuilder &>::type add(const char *key, T value) {
+        if (std::is_same<T, bool>::value)
+            return addBool(key, value != 0);
+        if (std::is_signed<T>::value)
+            return addSigned(key, static_cast<qint64>(value));
+        return addUnsigned(key, static_cast<quint64>(value));
+    }
+
+    /**
+     * Adds the markup as percent encoded json. Use EncodedReply to avoid serializing it per request.
+     */
+    RequestBuilder &add(const char *key, const GenericReply &reply);
+
+    /**
+     * Adds an already percent encoded value that is used as is. Multipart requests send it
+     * decoded, '+' counts as space as written by percentEncode.
+     */
+    RequestBuilder &addEncoded(const char *key, const QByteArray &value);
+
+    /**
+     * Adds a file. Requests containing files have to be sent as Networking::UPLOAD.
+     */
+    RequestBuilder &addFile(const char *key, const QByteArray &data, const QString &mimeType, const QString &filename);
+
+    /**
+     * Adds a file that is streamed from disk while the request is sent, it is never read into memory
+     * as a whole. The file has to exist until then.
+     */
+    RequestBuilder &addFilePath(const char *key, const QString &path, const QString &mimeType, const QString &filename);
+
+    bool isEmpty() const { return m_fields.isEmpty(); }
+    int count() const { return m_fields.size(); }
+    bool hasFiles() const;
+    bool hasStreamedFiles() const;
+
+    /**
+     * Approximate size of keys and values including files, without multipart framing.
+     */
+    qint64 contentSize() const;
+
+    /**
+     * application/x-www-form-urlencoded representation, usable as query or POST body.
+     */
+    QByteArray encoded() const;
+
+    /**
+     * multipart/form-data representation.
+     */
+    QByteArray multipart(const QByteArray &boundary) const;
+
+    /**
+     * Returns a boundary that does not occur in any file. Files added by addFilePath are not read
+     * for this, they get a 32 character random boundary instead.
+     */
+    QByteArray multipartBoundary() const;
+
+    /**
+     * multipart/form-data representation that reads files added by addFilePath on demand.
+     * @return 0 if one of them can't be opened
+     */
+    QHttpMultiPart *httpMultiPart() const;
+
+    /**
+     * application/x-www-form-urlencoded escaping of a single value.
+     */
+    static QByteArray percentEncode(const QByteArray &value);
+    static int encodedLength(const char *data, int length);
+    static char *percentEncode(const char *data, int length, char *out); // returns the end of the written data
+
+private:
+    struct Field {
+        enum Kind { Text, Encoded, Markup, File, FilePath };
+        Field() : kind(Text), key(0), keyLength(0), value(0), valueLength(0), mime(0), mimeLength(0) {}
+        Kind kind;
+        int key, keyLength;     // into m_data
+        int value, valueLength; // into m_data. Filename for files
+        int mime, mimeLength;   // into m_data. Files only
+        QByteArray payload;     // file data, path of streamed files or form encoded markup
+        QByteArray json;        // markup as used in multipart requests
+    };
+
+    Field &addField(Field::Kind kind, const char *key, int keyLength);
+    RequestBuilder withFilesLoaded() const;
+    int append(const char *data, int length);
+    RequestBuilder &addBool(const char *key, bool value);
+    RequestBuilder &addSigned(const char *key, qint64 value);
+    RequestBuilder &addUnsigned(const char *key, quint64 value);
+
+    QVarLengthArray<Field, 8> m_fields;
+    QByteArray m_data;
+};
+
+}
+
+#endif // REQUESTBUILDER_H
@@ -0,0 +1,136 @@
+#include "router.h"
+#include "conversation.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+Router::Router(QObject *parent) :
+    QObject(parent),
+    m_conversation(0)
+{
+}
+
+void Router::attach(Bot *bot)
+{
+    connect(bot, &Bot::message, this, &Router::route);
+}
+
+void Router::setBotUsername(const QString &username)
+{
+    m_botUsername = username.startsWith('@') ? username.mid(1) : username;
+}
+
+Router &Router::onCommand(const QString &command, CommandHandler handler)
+{
+    QString key = command.startsWith('/') ? command.mid(1) : command;
+    if (m_commands.contains(key))
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "replacing handler for command" << key;
+    m_commands.insert(key, handler);
+    return *this;
+}
+
+Router &Router::onRegex(const QRegularExpression &regex, RegexHandler handler)
+{
+    if (!regex.isValid()) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "invalid regex" << regex.pattern() << regex.errorString();
+        return *this;
+    }
+    QRegularExpression re(regex);
+    re.optimize();
+    m_regexes.append(qMakePair(re, handler));
+    return *this;
+}
+
+Router &Router::onType(Message::MessageType type, Handler handler)
+{
+    if (type >= 0 && type <= Message::GroupChatCreatedType)
+        m_typeHandlers[type] = handler;
+    return *this;
+}
+
+Router &Router::onChatType(Chat::ChatType type, Handler handler)
+{
+    if (type >= 0 && type <= Chat::Channel)
+        m_chatTypeHandlers[type] = handler;
+    return *this;
+}
+
+Router &Router::onDefault(Handler handler)
+{
+    m_default = handler;
+    return *this;
+}
+
+void Router::setConversation(Conversation *conversation)
+{
+    m_conversation = conversation;
+}
+
+void Router::route(uint64_t updateId, Message message)
+{
+    Q_UNUSED(updateId);
+    dispatch(message);
+}
+
+bool Router::dispatch(const Message &message)
+{
+    if (message.type == Message::TextType && dispatchCommand(message))
+        return true;
+
+    if (m_conversation && m_conversation->dispatch(message))
+        return true;
+
+    if (message.type == Message::TextType) {
+        for (int i = 0; i < m_regexes.size(); ++i) {
+            QRegularExpressionMatch match = m_regexes[i].first.match(message.string);
+            if (match.hasMatch()) {
+                m_regexes[i].second(message, match);
+                return true;
+            }
+        }
+    }
+
+    if (message.type >= 0 && message.type <= Message::GroupChatCreatedType && m_typeHandlers[message.type]) {
+        m_typeHandlers[message.type](message);
+        return true;
+    }
+
+    if (message.chat.type >= 0 && message.chat.type <= Chat::Channel && m_chatTypeHandlers[message.chat.type]) {
+        m_chatTypeHandlers[message.chat.type](message);
+        return true;
+    }
+
+    if (m_default) {
+        m_default(message);
+        return true;
+    }
+
+    return false;
+}
+
+bool Router::dispatchCommand(const Message &message)
+{
+    const QString &text = message.string;
+    if (m_commands.isEmpty() || !text.startsWith('/'))
+        return false;
+
+    // "/command@botname args"
+    int end = text.indexOf(' ');
+    if (end < 0)
+        end = text.length();
+    int at = text.indexOf('@');
+    int commandEnd = (at >= 0 && at < end) ? at : end;
+
+    if (commandEnd < end && !m_botUsername.isEmpty()) {
+        QStringRef addressee = text.midRef(commandEnd + 1, end - commandEnd - 1);
+        if (addressee.compare(m_botUsername, Qt::CaseInsensitive) != 0)
+            return false; // command for another bot
+    }
+
+    auto it = m_commands.constFind(text.mid(1, commandEnd - 1));
+    if (it == m_commands.constEnd())
+        return false;
+
+    it.value()(message, text.mid(end).trimmed());
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <functional>
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QRegularExpression>
+
+#include "types/message.h"
+
+namespace Telegram {
+
+class Bot;
+class Conversation;
+
+/**
+ * Dispatches incoming messages to handlers.
+ * Commands are looked up in a hash table, so the cost of routing a command depends on the length
+ * of the command only, not on the number of registered routes.
+ * Routes are tried in this order, the first matching one handles the message:
+ * command, running conversation, regular expression (in order of registration), message type,
+ * chat type, default.
+ */
+class Router : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void(const Message &message)> Handler;
+    typedef std::function<void(const Message &message, const QString &args)> CommandHandler;
+    typedef std::function<void(const Message &message, const QRegularExpressionMatch &match)> RegexHandler;
+
+    explicit Router(QObject *parent = 0);
+
+    /**
+     * Routes all messages received by bot.
+     */
+    void attach(Bot *bot);
+
+    /**
+     * Only commands without @botname suffix or addressed to this name are routed.
+     * @param username - bot username without '@'
+     */
+    void setBotUsername(const QString &username);
+
+    /**
+     * @param command - with or without leading '/'
+     * @param handler - gets the text following the command as args
+     */
+    Router &onCommand(const QString &command, CommandHandler handler);
+    Router &onRegex(const QRegularExpression &regex, RegexHandler handler);
+    Router &onType(Message::MessageType type, Handler handler);
+    Router &onChatType(Chat::ChatType type, Handler handler);
+    Router &onDefault(Handler handler);
+
+    /**
+     * Messages of chats with a running conversation are passed to it unless they are a command.
+     */
+    void setConversation(Conversation *conversation);
+
+    /**
+     * @return true if a handler was called
+     */
+    bool dispatch(const Message &message);
+
+public slots:
+    void route(uint64_t updateId, Message message);
+
+private:
+    bool dispatchCommand(const Message &message);
+
+    QString m_botUsername;
+    Conversation *m_conversation;
+    QHash<QString, CommandHandler> m_commands;
+    QVector<QPair<QRegularExpression, RegexHandler> > m_regexes;
+    Handler m_typeHandlers[Message::GroupChatCreatedType + 1];
+    Handler m_chatTypeHandlers[Chat::Channel + 1];
+    Handler m_default;
+};
+
+}
+
+#endif // ROUTER_H
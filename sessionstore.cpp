@@ -0,0 +1,234 @@
+#include <QSaveFile>
+#include <QFile>
+#include <QDataStream>
+#include "sessionstore.h"
+#include "qttelegrambot.h"
+
+using namespace Telegram;
+
+static const quint32 SNAPSHOT_MAGIC = 0x54475353; // "TGSS"
+static const quint32 SNAPSHOT_VERSION = 1;
+
+SessionStore::SessionStore(quint32 ttl, int shards, QObject *parent) :
+    QObject(parent),
+    m_ttl(ttl),
+    m_tickInterval(qMax<quint32>(1000, quint32((quint64(ttl) * 1000) / WheelSlots))),
+    m_ticks(0)
+{
+    m_ttlTicks = quint32((quint64(ttl) * 1000 + m_tickInterval - 1) / m_tickInterval);
+
+    int count = 1;
+    while (count < shards)
+        count <<= 1;
+    m_shardMask = uint(count - 1);
+    for (int i = 0; i < count; ++i) {
+        Shard *shard = new Shard;
+        shard->wheel.resize(WheelSlots);
+        m_shards.append(shard);
+    }
+
+    if (m_ttl) {
+        connect(&m_timer, &QTimer::timeout, this, &SessionStore::tick);
+        m_timer.start(int(m_tickInterval));
+    }
+}
+
+SessionStore::~SessionStore()
+{
+    m_timer.stop();
+    qDeleteAll(m_shards);
+}
+
+SessionStore::Shard &SessionStore::shardFor(const ChatId &chatId) const
+{
+    return *m_shards.at(int(qHash(chatId, 0x9e3779b9u) & m_shardMask));
+}
+
+void SessionStore::touch(Shard &shard, const ChatId &chatId, Entry &entry)
+{
+    if (!m_ttl)
+        return;
+
+    entry.expiresAt = m_ticks.load() + m_ttlTicks;
+    int slot = int(entry.expiresAt % WheelSlots);
+    if (entry.slot != slot) {
+        // the old slot keeps a stale reference, it's dropped when that slot is processed
+        shard.wheel[slot].append(chatId);
+        entry.slot = slot;
+    }
+}
+
+bool SessionStore::get(const ChatId &chatId, Session &session)
+{
+    Shard &shard = shardFor(chatId);
+    QMutexLocker lock(&shard.mutex);
+
+    auto it = shard.sessions.find(chatId);
+    if (it == shard.sessions.end())
+        return false;
+
+    touch(shard, chatId, it.value());
+    session = it.value().session;
+    return true;
+}
+
+void SessionStore::insert(const ChatId &chatId, const Session &session)
+{
+    Shard &shard = shardFor(chatId);
+    QMutexLocker lock(&shard.mutex);
+
+    Entry &entry = shard.sessions[chatId];
+    entry.session = session;
+    touch(shard, chatId, entry);
+}
+
+bool SessionStore::remove(const ChatId &chatId)
+{
+    Shard &shard = shardFor(chatId);
+    QMutexLocker lock(&shard.mutex);
+
+    return shard.sessions.remove(chatId) > 0;
+}
+
+void SessionStore::update(const ChatId &chatId, const std::function<void (Session &)> &fn)
+{
+    Shard &shard = shardFor(chatId);
+    QMutexLocker lock(&shard.mutex);
+
+    Entry &entry = shard.sessions[chatId];
+    fn(entry.session);
+    touch(shard, chatId, entry);
+}
+
+int SessionStore::size() const
+{
+    int ret = 0;
+    for (int i = 0; i < m_shards.size(); ++i) {
+        QMutexLocker lock(&m_shards[i]->mutex);
+        ret += m_shards[i]->sessions.size();
+    }
+    return ret;
+}
+
+void SessionStore::clear()
+{
+    for (int i = 0; i < m_shards.size(); ++i) {
+        Shard *shard = m_shards[i];
+        QMutexLocker lock(&shard->mutex);
+        shard->sessions.clear();
+        for (int s = 0; s < shard->wheel.size(); ++s)
+            shard->wheel[s].clear();
+    }
+}
+
+void SessionStore::tick()
+{
+    const quint64 now = m_ticks.fetchAndAddOrdered(1) + 1;
+    const int slot = int(now % WheelSlots);
+
+    QVector<QPair<ChatId, Session> > expiredSessions;
+    for (int i = 0; i < m_shards.size(); ++i) {
+        Shard *shard = m_shards[i];
+        QMutexLocker lock(&shard->mutex);
+
+        QVector<ChatId> due;
+        due.swap(shard->wheel[slot]);
+        for (int k = 0; k < due.size(); ++k) {
+            auto it = shard->sessions.find(due[k]);
+            if (it == shard->sessions.end() || it.value().slot != slot)
+                continue; // removed or moved to another slot
+            if (it.value().expiresAt <= now) {
+                expiredSessions.append(qMakePair(it.key(), it.value().session));
+                shard->sessions.erase(it);
+            } else {
+                shard->wheel[slot].append(due[k]); // due in a later round
+            }
+        }
+    }
+
+    for (int i = 0; i < expiredSessions.size(); ++i)
+        emit expired(expiredSessions[i].first, expiredSessions[i].second);
+}
+
+bool SessionStore::save(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "could not open" << fileName << file.errorString();
+        return false;
+    }
+
+    // collect first, so the count matches the records even if sessions change meanwhile
+    struct Record {
+        ChatId chatId;
+        Session session;
+        quint32 remaining;
+    };
+    QVector<Record> records;
+    const quint64 now = m_ticks.load();
+    for (int i = 0; i < m_shards.size(); ++i) {
+        const Shard *shard = m_shards[i];
+        QMutexLocker lock(&shard->mutex);
+        for (auto it = shard->sessions.constBegin(); it != shard->sessions.constEnd(); ++it) {
+            Record record;
+            record.chatId = it.key();
+            record.session = it.value().session;
+            record.remaining = 0;
+            if (m_ttl && it.value().expiresAt > now)
+                record.remaining = quint32(((it.value().expiresAt - now) * m_tickInterval) / 1000);
+            records.append(record);
+        }
+    }
+
+    QDataStream out(&file);
+    out << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << quint32(records.size());
+    foreach (const Record &record, records)
+        out << qint64(record.chatId.toInt()) << (record.chatId.isString() ? record.chatId.toString() : QString()) << qint32(record.session.state) << record.session.data << record.remaining;
+
+    return file.commit();
+}
+
+bool SessionStore::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "could not open" << fileName << file.errorString();
+        return false;
+    }
+
+    QDataStream in(&file);
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version >> count;
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+        qCWarning(CTelBot) << __PRETTY_FUNCTION__ << "not a session snapshot" << fileName;
+        return false;
+    }
+
+    const quint64 now = m_ticks.load();
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        qint64 id;
+        QString name;
+        qint32 state;
+        QVariantMap data;
+        quint32 remaining;
+        in >> id >> name >> state >> data >> remaining;
+        if (in.status() != QDataStream::Ok)
+            break;
+        if (m_ttl && !remaining)
+            continue; // expired while stored
+
+        const ChatId chatId = name.length() ? ChatId(name) : ChatId(id);
+        Shard &shard = shardFor(chatId);
+        QMutexLocker lock(&shard.mutex);
+        Entry &entry = shard.sessions[chatId];
+        entry.session.state = state;
+        entry.session.data = data;
+        if (m_ttl) {
+            entry.expiresAt = now + qMax<quint64>(1, (quint64(remaining) * 1000) / m_tickInterval);
+            entry.slot = int(entry.expiresAt % WheelSlots);
+            shard.wheel[entry.slot].append(chatId);
+        }
+    }
+
+    return in.status() == QDataStream::Ok;
+}
@@ -0,0 +1,107 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <functional>
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QVector>
+#include <QTimer>
+#include <QVariantMap>
+
+#include "types/chat.h"
+
+namespace Telegram {
+
+class Session
+{
+public:
+    Session() : state(0) {}
+
+    int state;        // 0 means no conversation running
+    QVariantMap data; // free for use by the handlers
+};
+
+/**
+ * In memory store for per chat sessions.
+ * Sessions are spread over independently locked shards, so it can be used from several threads.
+ * Sessions expire ttl seconds after their last access. Expiry is driven by a timing wheel, each
+ * tick only looks at the sessions that are due in that slot.
+ */
+class SessionStore : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @param ttl - seconds after the last access until a session is removed. 0 disables expiry
+     * @param shards - number of independently locked shards, rounded up to a power of 2
+     * @param parent
+     */
+    explicit SessionStore(quint32 ttl = 3600, int shards = 16, QObject *parent = 0);
+    ~SessionStore();
+
+    /**
+     * Copies the session of chatId to session and refreshes its ttl.
+     * @return false if there is no session for chatId
+     */
+    bool get(const ChatId &chatId, Session &session);
+    void insert(const ChatId &chatId, const Session &session);
+    bool remove(const ChatId &chatId);
+
+    /**
+     * Modifies the session in place while holding the shard lock. A session is created if needed.
+     * fn must not access the store.
+     */
+    void update(const ChatId &chatId, const std::function<void(Session &session)> &fn);
+
+    int size() const;
+    void clear();
+
+    /**
+     * Writes all sessions including their remaining ttl to fileName.
+     */
+    bool save(const QString &fileName) const;
+
+    /**
+     * Adds the sessions stored in fileName.
+     */
+    bool load(const QString &fileName);
+
+signals:
+    void expired(const ChatId &chatId, const Session &session);
+
+private slots:
+    void tick();
+
+private:
+    struct Entry {
+        Entry() : expiresAt(0), slot(-1) {}
+        Session session;
+        quint64 expiresAt; // in ticks
+        int slot;
+    };
+
+    struct Shard {
+        mutable QMutex mutex;
+        QHash<ChatId, Entry> sessions;
+        QVector<QVector<ChatId> > wheel;
+    };
+
+    Shard &shardFor(const ChatId &chatId) const;
+    void touch(Shard &shard, const ChatId &chatId, Entry &entry);
+
+    enum { WheelSlots = 64 };
+
+    quint32 m_ttl;
+    quint32 m_tickInterval; // msec
+    quint32 m_ttlTicks;
+    QAtomicInteger<quint64> m_ticks;
+    QVector<Shard *> m_shards;
+    uint m_shardMask;
+    QTimer m_timer;
+};
+
+}
+
+#endif // SESSIONSTORE_H
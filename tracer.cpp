@@ -0,0 +1,177 @@
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDebug>
+#include "tracer.h"
+#include "networking.h"
+
+using namespace Telegram;
+
+static thread_local quint64 s_currentUpdate = 0;
+
+Tracer::Tracer(int capacity) :
+    m_enabled(0),
+    m_capacity(qMax(1, capacity)),
+    m_next(0),
+    m_wrapped(false)
+{
+    m_clock.start();
+    m_epochUs = QDateTime::currentMSecsSinceEpoch() * 1000;
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    QMutexLocker lock(&m_mutex);
+    if (enabled && m_events.isEmpty())
+        m_events.resize(m_capacity);
+    m_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+void Tracer::setCapacity(int capacity)
+{
+    QMutexLocker lock(&m_mutex);
+    m_capacity = qMax(1, capacity);
+    m_events.clear();
+    if (m_enabled.load())
+        m_events.resize(m_capacity);
+    m_next = 0;
+    m_wrapped = false;
+}
+
+void Tracer::clear()
+{
+    setCapacity(m_capacity);
+}
+
+quint64 Tracer::currentUpdate() const
+{
+    return s_currentUpdate;
+}
+
+void Tracer::setCurrentUpdate(quint64 updateId)
+{
+    s_currentUpdate = updateId;
+}
+
+qint64 Tracer::now() const
+{
+    return m_epochUs + m_clock.nsecsElapsed() / 1000;
+}
+
+Tracer::Event &Tracer::append()
+{
+    Event &e = m_events[m_next];
+    if (++m_next == m_events.size()) {
+        m_next = 0;
+        m_wrapped = true;
+    }
+    return e;
+}
+
+void Tracer::complete(const char *name, const char *category, qint64 startUs, qint64 endUs, quint64 updateId, quint64 requestId, const QString &detail)
+{
+    if (!m_enabled.loadAcquire())
+        return;
+
+    QMutexLocker lock(&m_mutex);
+    Event &e = append();
+    e.name = name;
+    e.category = category;
+    e.phase = 'X';
+    e.ts = startUs;
+    e.dur = qMax<qint64>(0, endUs - startUs);
+    e.updateId = updateId;
+    e.requestId = requestId;
+    e.detail = detail;
+}
+
+void Tracer::instant(const char *name, const char *category, qint64 ts, quint64 updateId)
+{
+    if (!m_enabled.loadAcquire())
+        return;
+
+    QMutexLocker lock(&m_mutex);
+    Event &e = append();
+    e.name = name;
+    e.category = category;
+    e.phase = 'i';
+    e.ts = ts;
+    e.dur = 0;
+    e.updateId = updateId;
+    e.requestId = 0;
+    e.detail.clear();
+}
+
+static void appendJsonString(QByteArray &out, const QByteArray &s)
+{
+    out += '"';
+    for (int i = 0; i < s.size(); ++i) {
+        const char c = s.at(i);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uchar(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+QByteArray Tracer::chromeTrace() const
+{
+    QMutexLocker lock(&m_mutex);
+    QByteArray out;
+    out.reserve(128 * (m_wrapped ? m_events.size() : m_next) + 64);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    const int count = m_wrapped ? m_events.size() : m_next;
+    const int first = m_wrapped ? m_next : 0;
+    for (int i = 0; i < count; ++i) {
+        const Event &e = m_events.at((first + i) % m_events.size());
+        if (i)
+            out += ",\n";
+        out += "{\"name\":";
+        appendJsonString(out, e.name);
+        out += ",\"cat\":";
+        appendJsonString(out, e.category);
+        out += ",\"ph\":\"";
+        out += e.phase;
+        out += "\",\"ts\":";
+        out += QByteArray::number(e.ts);
+        if (e.phase == 'X') {
+            out += ",\"dur\":";
+            out += QByteArray::number(e.dur);
+        } else {
+            out += ",\"s\":\"t\"";
+        }
+        // one row per update, polling and unrelated requests on row 0
+        out += ",\"pid\":1,\"tid\":";
+        out += QByteArray::number(e.updateId);
+        out += ",\"args\":{\"update_id\":";
+        out += QByteArray::number(e.updateId);
+        if (e.requestId) {
+            out += ",\"request_id\":";
+            out += QByteArray::number(e.requestId);
+        }
+        if (!e.detail.isEmpty()) {
+            out += ",\"detail\":";
+            appendJsonString(out, e.detail.toUtf8());
+        }
+        out += "}}";
+    }
+
+    out += "]}\n";
+    return out;
+}
+
+bool Tracer::writeChromeTrace(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(CTelNet) << __PRETTY_FUNCTION__ << "could not open" << fileName << file.errorString();
+        return false;
+    }
+    file.write(chromeTrace());
+    return file.commit();
+}
@@ -0,0 +1,116 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QAtomicInt>
+
+namespace Telegram {
+
+/**
+ * Records timing spans of the update -> handler -> send pipeline.
+ * Spans are tied together by the update_id they belong to: requests sent while an update is
+ * dispatched, and callbacks of those requests, inherit its id. Events are kept in a ring buffer
+ * and can be written as Chrome trace (chrome://tracing, Perfetto), one row per update.
+ * Tracing is off by default and then costs a single atomic load per span. Recording is serialized
+ * by a mutex, the current update is tracked per thread.
+ */
+class Tracer
+{
+public:
+    explicit Tracer(int capacity = 100000);
+
+    /**
+     * The event buffer is allocated when tracing is enabled the first time. Disabling keeps the
+     * recorded events for chromeTrace().
+     */
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled.loadAcquire(); }
+
+    /**
+     * @param capacity - number of events kept, older ones are overwritten. Allocated right away
+     * only if tracing is enabled.
+     */
+    void setCapacity(int capacity);
+    void clear();
+
+    /**
+     * @return microseconds since epoch, monotonic while the tracer lives
+     */
+    qint64 now() const;
+
+    /**
+     * Update whose processing is running on the calling thread, 0 if none.
+     */
+    quint64 currentUpdate() const;
+    void setCurrentUpdate(quint64 updateId);
+
+    /**
+     * @param name - must be a string literal or outlive the tracer
+     * @param category - same as name
+     * @param detail - shown as argument, e.g. the endpoint
+     */
+    void complete(const char *name, const char *category, qint64 startUs, qint64 endUs, quint64 updateId,
+                  quint64 requestId = 0, const QString &detail = QString());
+    void instant(const char *name, const char *category, qint64 ts, quint64 updateId);
+
+    /**
+     * Records a span from construction until destruction.
+     */
+    class Span
+    {
+    public:
+        Span(Tracer *tracer, const char *name, const char *category, quint64 updateId) :
+            m_tracer(tracer->isEnabled() ? tracer : 0), m_name(name), m_category(category), m_updateId(updateId),
+            m_start(m_tracer ? m_tracer->now() : 0) {}
+        ~Span() {
+            if (m_tracer)
+                m_tracer->complete(m_name, m_category, m_start, m_tracer->now(), m_updateId);
+        }
+
+    private:
+        Q_DISABLE_COPY(Span)
+        Tracer *m_tracer;
+        const char *m_name;
+        const char *m_category;
+        quint64 m_updateId;
+        qint64 m_start;
+    };
+
+    /**
+     * @return recorded events in Chrome trace event format
+     */
+    QByteArray chromeTrace() const;
+    bool writeChromeTrace(const QString &fileName) const;
+
+private:
+    struct Event {
+        Event() : name(0), category(0), phase('X'), ts(0), dur(0), updateId(0), requestId(0) {}
+        const char *name;
+        const char *category;
+        char phase;
+        qint64 ts;
+        qint64 dur;
+        quint64 updateId;
+        quint64 requestId;
+        QString detail;
+    };
+
+    Event &append();
+
+    QAtomicInt m_enabled; // toggled on the bot thread, read by the I/O thread in IoThread mode
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    qint64 m_epochUs; // wall clock at m_clock start
+    QVector<Event> m_events; // empty until enabled
+    int m_capacity;
+    int m_next; // ring buffer write position
+    bool m_wrapped;
+};
+
+}
+
+#endif // TRACER_H
@@ -0,0 +1,15 @@
+#include "callbackquery.h"
+#include "../interner.h"
+
+using namespace Telegram;
+
+CallbackQuery::CallbackQuery(QJsonObject query)
+{
+    id = query.value("id").toString();
+    from = Interner::user(User(query.value("from").toObject()));
+    if (query.contains("message"))
+        message = Message(query.value("message").toObject());
+    inlineMessageId = query.value("inline_message_id").toString();
+    chatInstance = query.value("chat_instance").toString();
+    data = query.value("data").toString();
+}
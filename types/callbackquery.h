@@ -0,0 +1,47 @@
+#ifndef CALLBACKQUERY_H
+#define CALLBACKQUERY_H
+
+#include <QDebug>
+#include <QString>
+#include <QJsonObject>
+
+#include "message.h"
+#include "user.h"
+
+namespace Telegram {
+
+/**
+ * Button of an inline keyboard was pressed.
+ * @see https://core.telegram.org/bots/api#callbackquery
+ */
+class CallbackQuery
+{
+public:
+    CallbackQuery() {}
+    CallbackQuery(QJsonObject query);
+
+    QString id;
+    User from;
+
+    // optional, message with the button if it was sent by the bot, message.id is 0 otherwise
+    Message message;
+    QString inlineMessageId;
+
+    QString chatInstance;
+    QString data;
+};
+
+inline QDebug operator<< (QDebug dbg, const CallbackQuery &query)
+{
+    dbg.nospace() << qUtf8Printable(QString("Telegram::CallbackQuery(id=%1; from=%2; message=%3; data=%4)")
+                                    .arg(query.id)
+                                    .arg("User(" + QString::number(query.from.id) + ")")
+                                    .arg("Message(" + QString::number(query.message.id) + ")")
+                                    .arg(query.data));
+
+    return dbg.maybeSpace();
+}
+
+}
+
+#endif // CALLBACKQUERY_H
@@ -1,3 +1,4 @@
+#include <cstring>
 #include "chat.h"
 #include "message.h"
 using namespace Telegram;
@@ -9,29 +10,105 @@ Chat::Chat(QJsonObject chat)
     if (chatType == "private") type = Private;
     else if (chatType == "group") type = Group;
     else if (chatType == "channel") type = Channel;
+    title = chat.value("title").toString();
     username = chat.value("username").toString();
     firstname = chat.value("first_name").toString();
     lastname = chat.value("last_name").toString();
 }
 
-ChatId::ChatId(const Message &msg) {
-    if (msg.user.id) {
-        _idI = msg.user.id;
-    } else {
-        _idI = msg.chat.id;
+ChatId::ChatId(const QString &id) :
+    _idI(0),
+    _kind(Invalid)
+{
+    if (id.isEmpty())
+        return;
+
+    bool ok = false;
+    qint64 v = id.toLongLong(&ok, 10);
+    if (ok) {
+        char buf[DecimalSize];
+        _idI = v;
+        _kind = Numeric;
+        if (id == QLatin1String(buf, decimal(buf)))
+            return;
+        // not in canonical form (e.g. leading zeros or '+'), keep the string
+        _idI = 0;
     }
+    _idS = id;
+    _kind = Name;
+}
+
+ChatId::ChatId(const Message &msg) :
+    _idI(msg.user.id ? msg.user.id : msg.chat.id),
+    _kind(Numeric)
+{
+}
+
+QString ChatId::toString() const
+{
+    if (_kind == Numeric)
+        return QString::number(_idI);
+    return _idS;
+}
+
+int ChatId::decimal(char *buf) const
+{
+    if (_kind != Numeric)
+        return 0;
+
+    char tmp[DecimalSize];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    quint64 v = _idI < 0 ? quint64(0) - quint64(_idI) : quint64(_idI);
+    do {
+        *--p = char('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (_idI < 0)
+        *--p = '-';
+
+    const int length = int(end - p);
+    memcpy(buf, p, length);
+    return length;
 }
 
 bool ChatId::operator <(const ChatId &b) const
 {
-    if (_idS.length() && b._idS.length())
+    // invalid ids sort first
+    if (_kind == Invalid || b._kind == Invalid)
+        return _kind == Invalid && b._kind != Invalid;
+    if (isString() && b.isString())
         return _idS < b._idS;
-    if (_idS.length() || b._idS.length()) {
-        // mixed. convert both to strings:
-        QString sa (toString());
-        QString sb (b.toString());
-        return sa < sb;
-    }
+    // mixed: compare the string with the decimal representation
+    char buf[DecimalSize];
+    if (isString())
+        return QString::compare(_idS, QLatin1String(buf, b.decimal(buf))) < 0;
+    if (b.isString())
+        return QString::compare(QLatin1String(buf, decimal(buf)), b._idS) < 0;
     // both ints
     return _idI < b._idI;
 }
+
+bool ChatId::operator ==(const ChatId &b) const
+{
+    if (_kind != b._kind)
+        return false; // numeric strings are stored as ints, so a name never equals a number
+    if (isString())
+        return _idS == b._idS;
+    return _idI == b._idI;
+}
+
+uint Telegram::qHash(const ChatId &chatId, uint seed)
+{
+    if (chatId.isString())
+        return qHash(chatId.toString(), seed);
+
+    // 64 bit finalizer, spreads sequential ids over all buckets
+    quint64 x = quint64(chatId.toInt()) ^ seed;
+    x ^= x >> 33;
+    x *= Q_UINT64_C(0xff51afd7ed558ccd);
+    x ^= x >> 33;
+    x *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    x ^= x >> 33;
+    return uint(x);
+}
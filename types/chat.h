@@ -1,6 +1,7 @@
 #ifndef CHAT_H
 #define CHAT_H
 
+#include <functional>
 #include <QDebug>
 #include <QString>
 #include <QJsonObject>
@@ -10,28 +11,47 @@ namespace Telegram {
 class Chat;
 class Message;
 
+/**
+ * Chat identifier, either numeric or @channelname.
+ * A tagged 64 bit id or name, numeric ids are sent, compared and hashed without allocations.
+ * Strings holding a plain number are stored as numeric id. A default constructed id is invalid,
+ * neither numeric nor a name.
+ */
 class ChatId
 {
 public:
-    ChatId(int64_t id) : _idI(id) {}
-    ChatId(const QString &id) : _idI(0), _idS(id) {}
+    enum { DecimalSize = 20 }; // "-9223372036854775808"
+
+    ChatId(int64_t id) : _idI(id), _kind(Numeric) {}
+    ChatId(const QString &id);
     ChatId(const Message &msg); // prefer msg.from.id, then msg.chat.id
-    ChatId() = delete;
-    operator QVariant () const {
-        if (_idS.length())
-            return QVariant(_idS);
-        else
-            return QVariant(QString("%1").arg(_idI));
-    }
-    QString toString() const { if (_idS.length()) return _idS; else return QString("%1").arg(_idI);}
+    ChatId() : _idI(0), _kind(Invalid) {} // invalid id, needed for Qt containers
+    operator QVariant () const { return QVariant(toString()); }
+    QString toString() const; // empty for invalid ids
+    bool isString() const { return _kind == Name; }
+    bool isNumeric() const { return _kind == Numeric; }
+    bool isValid() const { return _kind != Invalid; }
+    int64_t toInt() const { return _idI; } // 0 for @channelname ids
+
+    /**
+     * Writes the decimal representation of a numeric id to buf, at least DecimalSize chars.
+     * @return length, 0 for names and invalid ids
+     */
+    int decimal(char *buf) const;
+
     bool operator<( const ChatId &b) const;
     bool operator==(const ChatId &b) const;
-    bool operator!=(const ChatId &b) const;
+    bool operator!=(const ChatId &b) const { return !(*this == b); }
 protected:
+    enum Kind { Invalid, Numeric, Name };
+
     int64_t _idI;
-    QString _idS;
+    QString _idS; // names only
+    quint8 _kind;
 };
 
+uint qHash(const ChatId &chatId, uint seed = 0);
+
 class Chat
 {
 public:
@@ -65,4 +85,10 @@ inline QDebug operator<< (QDebug dbg, const Chat &chat)
 
 }
 
+namespace std {
+template<> struct hash<Telegram::ChatId> {
+    size_t operator()(const Telegram::ChatId &chatId) const { return Telegram::qHash(chatId); }
+};
+}
+
 #endif // CHAT_H
@@ -3,6 +3,7 @@
 
 #include <QDebug>
 #include <QString>
+#include <QDir>
 
 namespace Telegram {
 
@@ -12,6 +13,12 @@ public:
     File(QString aFileId, qint64 aFileSize = -1,  QString filePath = QString()) :
     fileId(aFileId), fileSize(aFileSize), filePath(filePath) {}
 
+    /**
+     * A Bot API server started with --local returns absolute paths on its own disk instead of
+     * paths relative to the download url, the file can be opened directly then.
+     */
+    bool isLocal() const { return QDir::isAbsolutePath(filePath); }
+
     QString fileId;
     qint64 fileSize;
     QString filePath;
@@ -0,0 +1,15 @@
+#include "inlinequery.h"
+#include "../interner.h"
+
+using namespace Telegram;
+
+InlineQuery::InlineQuery(QJsonObject query)
+{
+    id = query.value("id").toString();
+    from = Interner::user(User(query.value("from").toObject()));
+    this->query = query.value("query").toString();
+    offset = query.value("offset").toString();
+    hasLocation = query.contains("location");
+    if (hasLocation)
+        location = Location(query.value("location").toObject());
+}
@@ -0,0 +1,46 @@
+#ifndef INLINEQUERY_H
+#define INLINEQUERY_H
+
+#include <QDebug>
+#include <QString>
+#include <QJsonObject>
+
+#include "user.h"
+#include "location.h"
+
+namespace Telegram {
+
+/**
+ * Incoming inline query, answered with answerInlineQuery.
+ * @see https://core.telegram.org/bots/api#inlinequery
+ */
+class InlineQuery
+{
+public:
+    InlineQuery() : hasLocation(false) {}
+    InlineQuery(QJsonObject query);
+
+    QString id;
+    User from;
+    QString query;
+    QString offset; // next_offset of the previous answer, empty for the first page
+
+    // optional, only for bots that request user location
+    Location location;
+    bool hasLocation;
+};
+
+inline QDebug operator<< (QDebug dbg, const InlineQuery &query)
+{
+    dbg.nospace() << qUtf8Printable(QString("Telegram::InlineQuery(id=%1; from=%2; query=%3; offset=%4)")
+                                    .arg(query.id)
+                                    .arg("User(" + QString::number(query.from.id) + ")")
+                                    .arg(query.query)
+                                    .arg(query.offset));
+
+    return dbg.maybeSpace();
+}
+
+}
+
+#endif // INLINEQUERY_H
@@ -1,5 +1,6 @@
 #include <QDebug>
 #include "message.h"
+#include "../interner.h"
 
 using namespace Telegram;
 
@@ -7,12 +8,12 @@ Message::~Message()
 {
 }
 
-Message::Message(QJsonObject message) : boolean(false)
+Message::Message(QJsonObject message) : type(TextType), boolean(false)
 {
     //qDebug() << __PRETTY_FUNCTION__ << message;
     id = message.value("message_id").toInt();
     date = QDateTime::fromMSecsSinceEpoch(1000ull*message.value("date").toInt());
-    chat = Chat(message.value("chat").toObject());
+    chat = Interner::chat(Chat(message.value("chat").toObject()));
 
     /**
     x audio               Audio     Optional. Message is an audio file, information about the file
@@ -32,10 +33,10 @@ Message::Message(QJsonObject message) : boolean(false)
     */
 
     if (message.contains("from")) {
-        from = User(message.value("from").toObject());
+        from = Interner::user(User(message.value("from").toObject()));
     }
     if (message.contains("forward_from")) {
-        forwardFrom = User(message.value("forward_from").toObject());
+        forwardFrom = Interner::user(User(message.value("forward_from").toObject()));
     }
     if (message.contains("forward_date")) {
         forwardDate = QDateTime::fromMSecsSinceEpoch(1000ull*message.value("forward_date").toInt());
@@ -61,7 +62,9 @@ Message::Message(QJsonObject message) : boolean(false)
         type = Message::DocumentType;
     }
     if (message.contains("photo")) {
-        foreach (QJsonValue val, message.value("photo").toArray()) {
+        const QJsonArray sizes = message.value("photo").toArray();
+        photo.reserve(sizes.size());
+        foreach (const QJsonValue &val, sizes) {
             photo.append(PhotoSize(val.toObject()));
         }
         type = Message::PhotoType;
@@ -93,12 +96,12 @@ Message::Message(QJsonObject message) : boolean(false)
     }
     if (message.contains("new_chat_participant")) {
         obj = message.value("new_chat_participant").toObject();
-        user = User(obj);
+        user = Interner::user(User(obj));
         type = Message::NewChatParticipantType;
     }
     if (message.contains("left_chat_participant")) {
         obj = message.value("left_chat_participant").toObject();
-        user = User(obj);
+        user = Interner::user(User(obj));
         type = Message::LeftChatParticipantType;
     }
     if (message.contains("new_chat_title")) {
@@ -106,7 +109,9 @@ Message::Message(QJsonObject message) : boolean(false)
         type = Message::NewChatTitleType;
     }
     if (message.contains("new_chat_photo")) {
-        foreach (QJsonValue val, message.value("new_chat_photo").toArray()) {
+        const QJsonArray sizes = message.value("new_chat_photo").toArray();
+        photo.reserve(sizes.size());
+        foreach (const QJsonValue &val, sizes) {
             photo.append(PhotoSize(val.toObject()));
         }
         type = Message::NewChatPhotoType;
@@ -25,7 +25,7 @@ namespace Telegram {
 class Message
 {
 public:
-    Message() : id(0), boolean(false) {}
+    Message() : id(0), type(TextType), boolean(false) {}
     Message(QJsonObject message);
     //Message(const Message &m); not needed with shared_ptr
     ~Message();
@@ -0,0 +1,44 @@
+#ifndef ENCODEDREPLY_H
+#define ENCODEDREPLY_H
+
+#include "genericreply.h"
+
+namespace Telegram {
+
+/**
+ * Immutable reply markup that is serialized only once.
+ * Use it for keyboards that are sent over and over again:
+ *
+ *     static const EncodedReply keyboard(ReplyKeyboardMarkup(...));
+ *     bot->sendMessage(chatId, text, false, false, -1, keyboard);
+ */
+class EncodedReply : public GenericReply
+{
+public:
+    EncodedReply(const GenericReply &reply)
+        : GenericReply(reply),
+          m_serialized(reply.serialize()),
+          m_json(m_serialized.toUtf8()),
+          m_formEncoded(QUrl::toPercentEncoding(m_serialized)) {}
+
+    virtual QString serialize() const {
+        return m_serialized;
+    }
+
+    virtual QByteArray json() const {
+        return m_json;
+    }
+
+    virtual QByteArray formEncoded() const {
+        return m_formEncoded;
+    }
+
+private:
+    const QString m_serialized;
+    const QByteArray m_json;
+    const QByteArray m_formEncoded;
+};
+
+}
+
+#endif // ENCODEDREPLY_H
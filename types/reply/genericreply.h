@@ -2,6 +2,7 @@
 #define GENERICREPLY_H
 
 #include <QString>
+#include <QUrl>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -25,6 +26,20 @@ public:
         return QString();
     }
 
+    /**
+     * Compact json representation as used for multipart uploads.
+     */
+    virtual QByteArray json() const {
+        return serialize().toUtf8();
+    }
+
+    /**
+     * Percent encoded json as used for application/x-www-form-urlencoded requests.
+     */
+    virtual QByteArray formEncoded() const {
+        return QUrl::toPercentEncoding(serialize());
+    }
+
     bool isValid() const {
         return valid;
     }
@@ -0,0 +1,95 @@
+#ifndef INLINEKEYBOARDMARKUP_H
+#define INLINEKEYBOARDMARKUP_H
+
+#include <QString>
+
+#include "genericreply.h"
+
+namespace Telegram {
+
+class InlineKeyboardButton
+{
+public:
+    /**
+     * Button that sends a CallbackQuery with data to the bot.
+     * @param data - 1-64 bytes, see CallbackDataWriter for packing state into it
+     */
+    static InlineKeyboardButton callback(const QString &text, const QString &data) {
+        InlineKeyboardButton b(text);
+        b.callbackData = data;
+        return b;
+    }
+
+    static InlineKeyboardButton link(const QString &text, const QString &url) {
+        InlineKeyboardButton b(text);
+        b.url = url;
+        return b;
+    }
+
+    /**
+     * Button that lets the user pick a chat and inserts the bot's username and query there.
+     */
+    static InlineKeyboardButton switchInline(const QString &text, const QString &query) {
+        InlineKeyboardButton b(text);
+        b.switchInlineQuery = query;
+        b.hasSwitchInlineQuery = true;
+        return b;
+    }
+
+    explicit InlineKeyboardButton(const QString &text = QString()) : text(text), hasSwitchInlineQuery(false) {}
+
+    /**
+     * Label text on the button
+     */
+    QString text;
+
+    // exactly one of the following
+    QString url;
+    QString callbackData;
+    QString switchInlineQuery; // may be empty
+    bool hasSwitchInlineQuery;
+
+    QJsonObject toJson() const {
+        QJsonObject o = QJsonObject();
+        o.insert("text", text);
+        if (!url.isEmpty())
+            o.insert("url", url);
+        else if (hasSwitchInlineQuery)
+            o.insert("switch_inline_query", switchInlineQuery);
+        else
+            o.insert("callback_data", callbackData);
+        return o;
+    }
+};
+
+typedef QList<QList<InlineKeyboardButton> > InlineKeyboard;
+
+class InlineKeyboardMarkup : public GenericReply
+{
+public:
+    InlineKeyboardMarkup(InlineKeyboard keyboard)
+        : GenericReply(false),
+          keyboard(keyboard) {}
+
+    /**
+     * Array of button rows, each represented by an Array of InlineKeyboardButton
+     */
+    InlineKeyboard keyboard;
+
+    virtual QString serialize() const {
+        QJsonObject o = QJsonObject();
+        QJsonArray keyboardMarkup = QJsonArray();
+        foreach (const QList<InlineKeyboardButton> &row, keyboard) {
+            QJsonArray buttons = QJsonArray();
+            foreach (const InlineKeyboardButton &button, row)
+                buttons.append(button.toJson());
+            keyboardMarkup.append(buttons);
+        }
+        o.insert("inline_keyboard", keyboardMarkup);
+        return serializeJson(o);
+    }
+};
+
+}
+
+#endif // INLINEKEYBOARDMARKUP_H
@@ -10,5 +10,11 @@ Update::Update(QJsonObject update)
     else
         if (update.contains("channel_post"))
             message = Message(update.value("channel_post").toObject());
+        else
+            if (update.contains("callback_query"))
+                callbackQuery = CallbackQuery(update.value("callback_query").toObject());
+            else
+                if (update.contains("inline_query"))
+                    inlineQuery = InlineQuery(update.value("inline_query").toObject());
 
 }
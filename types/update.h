@@ -4,6 +4,8 @@
 #include <QDebug>
 #include <QJsonObject>
 #include "message.h"
+#include "callbackquery.h"
+#include "inlinequery.h"
 
 namespace Telegram {
 
@@ -11,11 +13,13 @@ class Update
 {
 public:
     Update() = delete; //  {}
-    Update(const Update&u) : id(u.id), message(u.message) {}
+    Update(const Update&u) : id(u.id), message(u.message), callbackQuery(u.callbackQuery), inlineQuery(u.inlineQuery) {}
     Update(QJsonObject update);
 
     quint32 id;
     Message message;
+    CallbackQuery callbackQuery; // id is empty for other updates
+    InlineQuery inlineQuery; // same
 };
 
 inline QDebug operator<< (QDebug dbg, const Update &update)
@@ -0,0 +1,125 @@
+#include <QJsonDocument>
+#include "updatestreamparser.h"
+
+using namespace Telegram;
+
+UpdateStreamParser::UpdateStreamParser(int initialCapacity)
+{
+    // reserve() marks the capacity as reserved, resize(0) and remove() keep it from then on
+    m_buffer.reserve(initialCapacity);
+    reset();
+}
+
+void UpdateStreamParser::reset()
+{
+    m_buffer.resize(0);
+    m_pos = 0;
+    m_depth = 0;
+    m_stringStart = 0;
+    m_elementStart = -1;
+    m_updateCount = 0;
+    m_inString = false;
+    m_escape = false;
+    m_expectKey = false;
+    m_inResult = false;
+    m_ok = false;
+    m_lastKey.clear();
+}
+
+void UpdateStreamParser::feed(QIODevice *device, const UpdateHandler &handler)
+{
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return;
+
+    // read straight into the receive buffer
+    int oldSize = m_buffer.size();
+    m_buffer.resize(oldSize + int(available));
+    qint64 read = device->read(m_buffer.data() + oldSize, available);
+    m_buffer.resize(oldSize + int(qMax<qint64>(read, 0)));
+
+    parse(handler);
+}
+
+void UpdateStreamParser::feed(const char *data, int length, const UpdateHandler &handler)
+{
+    m_buffer.append(data, length);
+    parse(handler);
+}
+
+void UpdateStreamParser::parse(const UpdateHandler &handler)
+{
+    const char *data = m_buffer.constData();
+    const int size = m_buffer.size();
+
+    for (; m_pos < size; ++m_pos) {
+        const char c = data[m_pos];
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_inString = false;
+                if (m_depth == 1 && m_expectKey)
+                    m_lastKey = QByteArray(data + m_stringStart, m_pos - m_stringStart);
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            m_inString = true;
+            m_stringStart = m_pos + 1;
+            break;
+        case '{':
+        case '[':
+            if (m_depth == 1 && c == '[' && m_lastKey == "result")
+                m_inResult = true;
+            else if (m_inResult && m_depth == 2 && c == '{')
+                m_elementStart = m_pos;
+            ++m_depth;
+            if (m_depth == 1)
+                m_expectKey = true;
+            break;
+        case '}':
+        case ']':
+            --m_depth;
+            if (m_inResult && m_depth == 2 && c == '}' && m_elementStart >= 0) {
+                QJsonDocument d = QJsonDocument::fromJson(QByteArray::fromRawData(data + m_elementStart, m_pos + 1 - m_elementStart));
+                m_elementStart = -1;
+                ++m_updateCount;
+                handler(d.object());
+            } else if (m_inResult && m_depth == 1) {
+                m_inResult = false;
+            }
+            break;
+        case ',':
+            if (m_depth == 1)
+                m_expectKey = true;
+            break;
+        case ':':
+            if (m_depth == 1)
+                m_expectKey = false;
+            break;
+        case 't':
+            if (m_depth == 1 && !m_expectKey && m_lastKey == "ok")
+                m_ok = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // drop the bytes of updates that were handed out already
+    if (m_inResult) {
+        int keep = m_elementStart >= 0 ? m_elementStart : m_pos;
+        if (keep > 0) {
+            m_buffer.remove(0, keep);
+            m_pos -= keep;
+            m_stringStart -= keep;
+            if (m_elementStart >= 0)
+                m_elementStart = 0;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef UPDATESTREAMPARSER_H
+#define UPDATESTREAMPARSER_H
+
+#include <functional>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QIODevice>
+
+namespace Telegram {
+
+/**
+ * Incremental parser for getUpdates responses.
+ * Feed it the response as it arrives, each element of the "result" array is handed out as soon as
+ * its closing brace was received. Bytes of already handled updates are dropped, the receive buffer
+ * keeps its capacity across reset() so long polls don't reallocate.
+ */
+class UpdateStreamParser
+{
+public:
+    typedef std::function<void(const QJsonObject &update)> UpdateHandler;
+
+    UpdateStreamParser(int initialCapacity = 64 * 1024);
+
+    /**
+     * Prepare for a new response.
+     */
+    void reset();
+
+    /**
+     * Reads all available bytes from device and calls handler for each complete update.
+     */
+    void feed(QIODevice *device, const UpdateHandler &handler);
+    void feed(const char *data, int length, const UpdateHandler &handler);
+
+    /**
+     * True once "ok":true was seen in the response.
+     */
+    bool isOk() const { return m_ok; }
+
+    /**
+     * Number of updates handed out since the last reset().
+     */
+    int updateCount() const { return m_updateCount; }
+
+    /**
+     * Unprocessed part of the response. Contains the whole response if it was an error description.
+     */
+    const QByteArray &pendingData() const { return m_buffer; }
+
+private:
+    void parse(const UpdateHandler &handler);
+
+    QByteArray m_buffer;
+    int m_pos;           // next byte in m_buffer to look at
+    int m_depth;
+    int m_stringStart;
+    int m_elementStart;  // start of the current result element or -1
+    int m_updateCount;
+    bool m_inString;
+    bool m_escape;
+    bool m_expectKey;
+    bool m_inResult;
+    bool m_ok;
+    QByteArray m_lastKey;
+};
+
+}
+
+#endif // UPDATESTREAMPARSER_H